@@ -0,0 +1,759 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <time.h>
+#include "wtrie.h"
+#include "wsnippets.h"
+#include "wmarkov.h"
+#include "whash.h"
+#include "wfrozen.h"
+#include "wrandom.h"
+
+#define _FAIL(X) goto X
+
+#define BENCH_WORDS   4096      //!< Number of distinct words of the synthetic corpus.
+#define BENCH_LOOKUPS (1 << 20) //!< Number of lookups timed by lookup benchmarks.
+
+/** @brief Settings of a benchmark run, see main for their options. */
+
+struct bench_conf
+{
+    uint64_t    seed;       //!< Seed of the synthetic corpus, of sampling and of generation.
+    unsigned    threads;    //!< Number of threads of parallel training.
+    unsigned    maxcontext; //!< Longest length of contexts to train with.
+    unsigned    reps;       //!< Number of repetitions of every measurement, the best one is kept.
+    size_t      length;     //!< Number of symbols to generate.
+    int         alphabet;   //!< Whether to train on IDs of an alphabet rather than on code points.
+    const char* tmpdir;     //!< Directory for the synthetic corpus and models.
+};
+
+/** @brief Returns seconds of a monotonic clock. */
+
+double bench_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** @brief Prints one measurement as a line of name, value and unit. */
+
+void bench_report (const char* name, double value, const char* unit)
+{
+    printf ("  %-34s %14.3f %s\n", name, value, unit);
+}
+
+/** @brief Prints one count as a line of name and value. */
+
+void bench_count (const char* name, size_t value)
+{
+    printf ("  %-34s %10zu\n", name, value);
+}
+
+/** @brief Service function returning the size of the file in bytes, 0 if fails. */
+
+size_t bench_filesize (const char* fname)
+{
+    struct stat st;
+    return stat (fname, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+/** @brief Writes @b size bytes or a bit more of synthetic text to the file, the same for the same seed.
+ *
+ * The text is made of BENCH_WORDS words of 1 to 10 letters, Latin and Cyrillic mixed to have multibyte
+ * UTF-8 in it, drawn with frequencies falling off steeply from the first words, as in natural text, and
+ * broken into lines of about 70 symbols.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_synth (const char* fname, size_t size, uint64_t seed)
+{
+    static const wchar_t LETTERS[] = L"etaoinshrdlucmfwypvbgkjqxzабвгдеклмнопрст";
+    const unsigned nletters = sizeof (LETTERS) / sizeof (wchar_t) - 1;
+
+    struct wRandom rng;
+    wRandom_seed (&rng, seed);
+
+    wchar_t (*words)[12] = malloc (BENCH_WORDS * sizeof (*words));
+    if (!words) return 0;
+    for (unsigned w = 0; w < BENCH_WORDS; w++)
+    {
+        unsigned n = 1 + wRandom_next (&rng) % 10;
+        for (unsigned j = 0; j < n; j++)
+        {
+            uint64_t r = wRandom_next (&rng);
+            words[w][j] = (r & 3) ? LETTERS[(r >> 8) % 26] : LETTERS[26 + (r >> 8) % (nletters - 26)];
+        }
+        words[w][n] = L'\0';
+    }
+
+    int fd = open (fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct wOutbuf out;
+    int ok = fd >= 0 && wOutbuf_fd (&out, fd, 0);
+    if (!ok)
+    {
+        if (fd >= 0) close (fd);
+        free (words);
+        return 0;
+    }
+
+    size_t col = 0;
+    while (out.total < size && !out.failed)
+    {
+        // Uniform below a uniform bound: word w is drawn with probability about ln (BENCH_WORDS / w) / BENCH_WORDS.
+        unsigned bound = 1 + wRandom_next (&rng) % BENCH_WORDS;
+        unsigned w = wRandom_next (&rng) % bound;
+        for (const wchar_t* wch = words[w]; *wch; wch++, col++)
+            wOutbuf_put (&out, *wch);
+
+        wOutbuf_put (&out, col >= 70 ? L'\n' : L' ');
+        col = (col >= 70 ? 0 : col + 1);
+    }
+
+    ok = wOutbuf_close (&out);
+    ok = (close (fd) == 0) && ok;
+    free (words);
+    return ok;
+}
+
+/** @brief Measures loading the corpus with wloadfile, finding its lines in place with wCorpus_lines and
+ * writing it back through wOutbuf to /dev/null.
+ *
+ * @return NULL if fails, the corpus as loaded otherwise.
+ */
+
+wchar_t* bench_io (const struct bench_conf* conf, const char* fname, size_t bytes)
+{
+    wchar_t* wbuffer = NULL;
+    double best = 0;
+    for (unsigned r = 0; r < conf -> reps; r++)
+    {
+        double t0 = bench_now ();
+        wbuffer = wloadfile (fname, wbuffer);
+        double t = bench_now () - t0;
+        if (!wbuffer) return NULL;
+        if (!r || t < best) best = t;
+    }
+    bench_report ("wloadfile", bytes / best * 1e-6, "MB/s");
+
+    struct wCorpus corpus;
+    if (wCorpus_open (&corpus, fname))
+    {
+        size_t nlines = 0;
+        best = 0;
+        for (unsigned r = 0; r < conf -> reps; r++)
+        {
+            double t0 = bench_now ();
+            struct wSpan* lines = wCorpus_lines (&corpus, &nlines);
+            double t = bench_now () - t0;
+            free (lines);
+            if (!r || t < best) best = t;
+        }
+        wCorpus_close (&corpus);
+        if (best > 0) bench_report ("wCorpus_lines", bytes / best * 1e-6, "MB/s");
+        bench_count ("lines", nlines);
+    }
+
+    int fd = open ("/dev/null", O_WRONLY);
+    if (fd < 0) return wbuffer;
+    best = 0;
+    for (unsigned r = 0; r < conf -> reps; r++)
+    {
+        struct wOutbuf out;
+        if (!wOutbuf_fd (&out, fd, 0)) break;
+        double t0 = bench_now ();
+        for (const wchar_t* wch = wbuffer; *wch; wch++) wOutbuf_put (&out, *wch);
+        wOutbuf_close (&out);
+        double t = bench_now () - t0;
+        if (!r || t < best) best = t;
+    }
+    close (fd);
+    if (best > 0) bench_report ("wOutbuf to /dev/null", bytes / best * 1e-6, "MB/s");
+
+    return wbuffer;
+}
+
+/** @brief Measures sorting the lines of the corpus with wsortlines, from their beginnings and their ends,
+ * against qsort_r with alpha_strcmp_r.
+ */
+
+void bench_sort (const struct bench_conf* conf, const wchar_t* wbuffer, size_t nsyms)
+{
+    wchar_t* copy = malloc ((nsyms + 1) * sizeof (wchar_t));
+    if (!copy) return;
+    wmemcpy (copy, wbuffer, nsyms + 1);
+    int n = 0;
+    wchar_t** lines = wsplitlines_exp (copy, &n);
+    wchar_t** sorted = lines ? malloc ((n + 1) * sizeof (wchar_t*)) : NULL;
+
+    const char* names[3] = { "wsortlines", "wsortlines, rhymes", "qsort_r alpha_strcmp_r" };
+    for (unsigned k = 0; sorted && k < 3; k++)
+    {
+        char dir = (k == 1) ? DFROMEND : DFROMBGN;
+        double best = 0;
+        for (unsigned r = 0; r < conf -> reps; r++)
+        {
+            double t0 = bench_now ();
+            size_t* perm = NULL;
+            if (k < 2)
+                perm = wsortlines (lines, n, dir);
+            else
+            {
+                memcpy (sorted, lines, n * sizeof (wchar_t*));
+                qsort_r (sorted, n, sizeof (wchar_t*), alpha_strcmp_r, &dir);
+            }
+            double t = bench_now () - t0;
+            free (perm);
+            if (!r || t < best) best = t;
+        }
+        bench_report (names[k], best * 1e3, "ms");
+    }
+
+    free (sorted);
+    free (lines);
+    free (copy);
+}
+
+/** @brief Trains a model of the file on @b threads threads from scratch, with the alphabet unless it is NULL,
+ * on lines as documents if @b lines is set.
+ *
+ * @return 0 if fails, 1 otherwise, with the trained model in @b tr and its nodes in @b pool.
+ */
+
+int bench_train (struct wMarkov_trainer* tr, struct wTrie_pool* pool, const char* fname, unsigned context,
+                 unsigned threads, struct wAlpha* alpha, int lines)
+{
+    wTrie_pool_init (pool, 0);
+    struct wTrie* root = wTrie_pool_node (pool, L'\0', 0, NULL, 0);
+    int ok = root && wMarkov_trainer_init (tr, pool, root, context);
+    if (ok) tr -> alpha = alpha;
+    ok = ok && (!lines || wMarkov_trainer_lines (tr));
+    ok = ok && wMarkov_trainpar (tr, fname, threads);
+    if (!ok) wTrie_pool_free (pool);
+    return ok;
+}
+
+/** @brief Measures wTrie_child and wTrie_findword on windows of the corpus drawn at random.
+ *
+ * Every window is a context followed by its transition, so every lookup succeeds. wTrie_child is timed
+ * descending from the root symbol by symbol down to the transition, wTrie_findword finding the context
+ * of the window as a string.
+ */
+
+void bench_lookups (const struct bench_conf* conf, struct wTrie* root, const wchar_t* wbuffer, size_t nsyms,
+                    unsigned context)
+{
+    if (nsyms < context + WMARKOV_LAG + 2) return;
+
+    wchar_t* words = malloc ((size_t)BENCH_LOOKUPS * (context + 2) * sizeof (wchar_t));
+    if (!words) return;
+
+    struct wRandom rng;
+    wRandom_stream (&rng, conf -> seed, context);
+    for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        size_t pos = wRandom_next (&rng) % (nsyms - context - WMARKOV_LAG - 1);
+        wchar_t* word = words + i * (context + 2);
+        wmemcpy (word, wbuffer + pos, context + 1);
+        word[context + 1] = L'\0';
+    }
+
+    double best_child = 0;
+    double best_find  = 0;
+    size_t found = 0;
+    for (unsigned r = 0; r < conf -> reps; r++)
+    {
+        double t0 = bench_now ();
+        for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+        {
+            struct wTrie* wtr = root;
+            const wchar_t* word = words + i * (context + 2);
+            for (unsigned j = 0; j <= context && wtr; j++) wtr = wTrie_child (wtr, word[j], NULL);
+            found += (wtr != NULL);
+        }
+        double t1 = bench_now ();
+        for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+        {
+            wchar_t* word = words + i * (context + 2);
+            wchar_t wch = word[context];
+            word[context] = L'\0';
+            found += (wTrie_findword (root, word) != NULL);
+            word[context] = wch;
+        }
+        double t2 = bench_now ();
+
+        if (!r || t1 - t0 < best_child) best_child = t1 - t0;
+        if (!r || t2 - t1 < best_find)  best_find  = t2 - t1;
+    }
+    free (words);
+
+    bench_report ("wTrie_child", best_child / ((double)BENCH_LOOKUPS * (context + 1)) * 1e9, "ns/call");
+    bench_report ("wTrie_findword", best_find / BENCH_LOOKUPS * 1e9, "ns/word");
+    if (found != 2 * (size_t)BENCH_LOOKUPS * conf -> reps)
+        bench_count ("lookups missed", 2 * (size_t)BENCH_LOOKUPS * conf -> reps - found);
+}
+
+/** @brief Measures training with the hash backend, see whash.h: counting windows of the file into the table
+ * and adding the table to an empty trie separately, and the memory of both.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_hash (const struct bench_conf* conf, const char* fname, unsigned context, size_t bytes,
+                struct wAlpha* alpha)
+{
+    double best_count = 0;
+    double best_apply = 0;
+    size_t table = 0;
+    size_t nkeys = 0;
+    size_t pooled = 0;
+    for (unsigned r = 0; r < conf -> reps; r++)
+    {
+        struct wMarkov_trainer tr;
+        struct wTrie_pool pool;
+        struct wHash hs;
+        wTrie_pool_init (&pool, 0);
+        struct wTrie* root = wTrie_pool_node (&pool, L'\0', 0, NULL, 0);
+
+        double t0 = bench_now ();
+        int ok = root && wMarkov_trainer_init (&tr, &pool, root, context);
+        if (ok) tr.alpha = alpha;
+        ok = ok && wHash_init (&hs, &tr);
+        if (ok && !wMarkov_readfile (fname, alpha, wHash_feedchunk, &hs))
+        {
+            wHash_free (&hs);
+            ok = 0;
+        }
+        double t1 = bench_now ();
+        if (ok)
+        {
+            table = wHash_bytes (&hs);
+            nkeys = hs.nkeys;
+            ok = wHash_apply (&hs, &tr);
+        }
+        double t2 = bench_now ();
+        pooled = pool.nbytes;
+        wTrie_pool_free (&pool);
+        if (!ok) return 0;
+
+        if (!r || t1 - t0 < best_count) best_count = t1 - t0;
+        if (!r || t2 - t1 < best_apply) best_apply = t2 - t1;
+    }
+
+    bench_report ("hash, train", bytes / (best_count + best_apply) * 1e-6, "MB/s");
+    bench_report ("hash, count", bytes / best_count * 1e-6, "MB/s");
+    bench_report ("hash, to trie", best_apply * 1e3, "ms");
+    bench_count ("hash windows", nkeys);
+    bench_report ("hash table", table * 1e-6, "MB");
+    bench_report ("hash table per window", nkeys ? (double)table / nkeys : 0, "B");
+    bench_report ("hash peak, table and trie", (table + pooled) * 1e-6, "MB");
+    return 1;
+}
+
+/** @brief Measures generation from the model into memory, without encoding costs of the output path.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_generate (const struct bench_conf* conf, const struct wFrozen* fz, const char* name)
+{
+    size_t cap = conf -> length * 4;
+    unsigned char* mem = malloc (cap);
+    if (!mem) return 0;
+
+    double best = 0;
+    for (unsigned r = 0; r < conf -> reps; r++)
+    {
+        struct wRandom rng;
+        struct wOutbuf out;
+        wRandom_seed (&rng, conf -> seed);
+        wOutbuf_mem (&out, mem, cap);
+        double t0 = bench_now ();
+        wFrozen_walk (fz, &rng, conf -> length, &out);
+        double t = bench_now () - t0;
+        if (!r || t < best) best = t;
+    }
+    free (mem);
+
+    bench_report (name, conf -> length / best * 1e-6, "Msym/s");
+    return 1;
+}
+
+/** @brief Measures generation of WFROZEN_GROUP documents into memory one at a time with wFrozen_walk, then
+ * interleaved with wFrozen_walkgroup, with the same symbols in all. Names of the results start with
+ * @b prefix.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_group (const struct bench_conf* conf, const struct wFrozen* fz, const char* prefix)
+{
+    size_t length = conf -> length / WFROZEN_GROUP ? conf -> length / WFROZEN_GROUP : 1;
+    size_t cap = length * 8;
+    unsigned char* mem = malloc (WFROZEN_GROUP * cap);
+    if (!mem) return 0;
+
+    double best[2] = { 0, 0 };
+    size_t total = 0;
+    for (unsigned r = 0; r < conf -> reps; r++)
+    {
+        struct wFrozen_stream st[WFROZEN_GROUP];
+        for (unsigned k = 0; k < 2; k++)
+        {
+            for (unsigned j = 0; j < WFROZEN_GROUP; j++)
+            {
+                wRandom_stream (&st[j].rng, conf -> seed, j);
+                wOutbuf_mem (&st[j].out, mem + j * cap, cap);
+            }
+            double t0 = bench_now ();
+            if (k) wFrozen_walkgroup (fz, st, WFROZEN_GROUP, length);
+            else
+                for (unsigned j = 0; j < WFROZEN_GROUP; j++) wFrozen_walk (fz, &st[j].rng, length, &st[j].out);
+            double t = bench_now () - t0;
+            if (!r || t < best[k]) best[k] = t;
+        }
+        total = 0;
+        for (unsigned j = 0; j < WFROZEN_GROUP; j++) total += st[j].i;
+    }
+    free (mem);
+
+    char name[48];
+    snprintf (name, sizeof (name), "%sgenerate %u one at a time", prefix, WFROZEN_GROUP);
+    bench_report (name, total / best[0] * 1e-6, "Msym/s");
+    snprintf (name, sizeof (name), "%sgenerate %u interleaved", prefix, WFROZEN_GROUP);
+    bench_report (name, total / best[1] * 1e-6, "Msym/s");
+    return 1;
+}
+
+/** @brief Service function putting into @b p the probability of every edge of @b state to be picked, from
+ * the alias table of the state.
+ */
+
+void bench_probs (const struct wFrozen* fz, uint32_t state, double* p)
+{
+    uint32_t base = fz -> offs[state];
+    uint32_t k    = fz -> offs[state + 1] - base;
+    for (uint32_t j = 0; j < k; j++) p[j] = 0;
+    if (k == 1) p[0] = 1;
+    for (uint32_t j = 0; k > 1 && j < k; j++)
+    {
+        double keep = fz -> qcols ? fz -> qcols[base + j].prob / 65536.0
+                                  : (double)fz -> cols[base + j].prob / fz -> total[state];
+        uint32_t alias = fz -> qcols ? fz -> qcols[base + j].alias : fz -> cols[base + j].alias - base;
+        p[j] += keep / k;
+        p[alias] += (1 - keep) / k;
+    }
+}
+
+/** @brief Measures how far the probabilities of edges of the packed model @b pk are from those of the
+ * model @b fz it was packed from: the largest difference for an edge, and the total variation distance
+ * between the distributions of a state, on average over states.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_accuracy (const struct wFrozen* fz, const struct wFrozen* pk)
+{
+    double* p = malloc (2 * 65536 * sizeof (double));
+    if (!p) return 0;
+
+    double maxdiff = 0, variation = 0;
+    for (uint32_t s = 0; s < fz -> nstates; s++)
+    {
+        uint32_t k = fz -> offs[s + 1] - fz -> offs[s];
+        double tv = 0;
+        bench_probs (fz, s, p);
+        bench_probs (pk, s, p + 65536);
+        for (uint32_t j = 0; j < k; j++)
+        {
+            double d = p[j] > p[65536 + j] ? p[j] - p[65536 + j] : p[65536 + j] - p[j];
+            if (d > maxdiff) maxdiff = d;
+            tv += d / 2;
+        }
+        variation += tv;
+    }
+    free (p);
+
+    bench_report ("packed, largest error", maxdiff * 1e6, "ppm");
+    bench_report ("packed, variation", fz -> nstates ? variation / fz -> nstates * 1e6 : 0, "ppm");
+    return 1;
+}
+
+/** @brief Measures packing the model and generation from the packed model, see wFrozen_pack, and how much
+ * smaller and less exact it is.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_packed (const struct bench_conf* conf, const struct wFrozen* fz, const char* model_fname)
+{
+    double t0 = bench_now ();
+    struct wFrozen* pk = wFrozen_pack (fz);
+    double t1 = bench_now ();
+    if (!pk) return 0;
+    bench_report ("pack", (t1 - t0) * 1e3, "ms");
+
+    int ok = wFrozen_save (pk, model_fname);
+    if (ok) bench_report ("packed model file", bench_filesize (model_fname) * 1e-6, "MB");
+    ok = ok && bench_accuracy (fz, pk) && bench_generate (conf, pk, "packed, generate") &&
+         bench_group (conf, pk, "packed, ");
+    wFrozen_free (pk);
+    return ok;
+}
+
+/** @brief Measures the time from starting to load the model file to its first generated byte written. */
+
+void bench_firstbyte (const struct bench_conf* conf, const char* model_fname)
+{
+    int fd = open ("/dev/null", O_WRONLY);
+    if (fd < 0) return;
+
+    double best = 0;
+    for (unsigned r = 0; r < conf -> reps; r++)
+    {
+        double t0 = bench_now ();
+        struct wFrozen* fz = wFrozen_load (model_fname);
+        if (!fz) break;
+
+        struct wRandom rng;
+        struct wOutbuf out;
+        wRandom_seed (&rng, conf -> seed);
+        int ok = wOutbuf_fd (&out, fd, 0);
+        if (ok)
+        {
+            wFrozen_walk (fz, &rng, 1, &out);
+            ok = wOutbuf_close (&out);
+        }
+        double t = bench_now () - t0;
+        wFrozen_free (fz);
+        if (!ok) break;
+        if (!r || t < best) best = t;
+    }
+    close (fd);
+
+    if (best > 0) bench_report ("load to first byte", best * 1e3, "ms");
+}
+
+/** @brief Runs every benchmark of the model of contexts of @b context symbols of the corpus.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_context (const struct bench_conf* conf, const char* fname, const wchar_t* wbuffer, size_t bytes,
+                   size_t nsyms, unsigned context, struct wAlpha* alpha, const char* model_fname)
+{
+    printf (" context %u\n", context);
+
+    struct wMarkov_trainer tr;
+    struct wTrie_pool pool;
+    unsigned threads[2] = { 1, conf -> threads };
+    for (unsigned k = 0; k < (conf -> threads > 1 ? 2u : 1u); k++)
+    {
+        if (k) wTrie_pool_free (&pool);
+
+        double best = 0;
+        for (unsigned r = 0; r < conf -> reps; r++)
+        {
+            if (r) wTrie_pool_free (&pool);
+            double t0 = bench_now ();
+            if (!bench_train (&tr, &pool, fname, context, threads[k], alpha, 0)) return 0;
+            double t = bench_now () - t0;
+            if (!r || t < best) best = t;
+        }
+
+        char name[32];
+        snprintf (name, sizeof (name), "train, %u thread%s", threads[k], threads[k] > 1 ? "s" : "");
+        bench_report (name, bytes / best * 1e-6, "MB/s");
+    }
+    bench_count ("nodes", pool.nnodes);
+    bench_report ("pool", pool.nbytes * 1e-6, "MB");
+    bench_report ("pool bytes per node", pool.nnodes ? (double)pool.nbytes / pool.nnodes : 0, "B");
+
+    if (alpha)
+    {
+        struct wMarkov_trainer lines;
+        struct wTrie_pool linepool;
+        double best = 0;
+        for (unsigned r = 0; r < conf -> reps; r++)
+        {
+            double t0 = bench_now ();
+            int ok = bench_train (&lines, &linepool, fname, context, conf -> threads, alpha, 1);
+            double t = bench_now () - t0;
+            if (!ok) break;
+            wTrie_pool_free (&linepool);
+            if (!r || t < best) best = t;
+        }
+
+        char name[32];
+        snprintf (name, sizeof (name), "lines, %u thread%s", conf -> threads, conf -> threads > 1 ? "s" : "");
+        if (best > 0) bench_report (name, bytes / best * 1e-6, "MB/s");
+    }
+
+    if (!bench_hash (conf, fname, context, bytes, alpha))
+    {
+        wTrie_pool_free (&pool);
+        return 0;
+    }
+
+    bench_lookups (conf, tr.root, wbuffer, nsyms, context);
+
+    double t0 = bench_now ();
+    struct wFrozen* fz = wFrozen_freeze (tr.root, tr.start, tr.context, alpha);
+    double t1 = bench_now ();
+    wTrie_pool_free (&pool);
+    if (!fz) return 0;
+    bench_report ("freeze", (t1 - t0) * 1e3, "ms");
+    bench_count ("states", fz -> nstates);
+    bench_count ("edges", fz -> nedges);
+
+    t0 = bench_now ();
+    int ok = wFrozen_save (fz, model_fname);
+    t1 = bench_now ();
+    if (ok)
+    {
+        bench_report ("save", (t1 - t0) * 1e3, "ms");
+        bench_report ("model file", bench_filesize (model_fname) * 1e-6, "MB");
+    }
+
+    ok = bench_generate (conf, fz, "generate") && bench_group (conf, fz, "") && ok;
+    if (ok) bench_firstbyte (conf, model_fname);
+    ok = ok && bench_packed (conf, fz, model_fname);
+    wFrozen_free (fz);
+    unlink (model_fname);
+    return ok;
+}
+
+/** @brief Runs every benchmark on the corpus in the file, for lengths of contexts 1, 2, 4... and maxcontext.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int bench_corpus (const struct bench_conf* conf, const char* fname, const char* model_fname)
+{
+    size_t bytes = bench_filesize (fname);
+    if (!bytes) return 0;
+
+    printf ("%s: %zu bytes\n", fname, bytes);
+    wchar_t* wbuffer = bench_io (conf, fname, bytes);
+    if (!wbuffer) return 0;
+    size_t nsyms = wcslen (wbuffer);
+    bench_count ("symbols", nsyms);
+    bench_sort (conf, wbuffer, nsyms);
+
+    // Lookups go by symbols of the trie, so the corpus is mapped to IDs as well
+    struct wAlpha alpha;
+    wAlpha_init (&alpha);
+    int ok = 1;
+    if (conf -> alphabet)
+    {
+        double t0 = bench_now ();
+        ok = wMarkov_alphabet (&alpha, fname);
+        double t = bench_now () - t0;
+        bench_report ("alphabet", bytes / t * 1e-6, "MB/s");
+        bench_count ("alphabet symbols", alpha.n);
+        wAlpha_map (&alpha, wbuffer, nsyms);
+    }
+
+    for (unsigned context = 1; ok; context *= 2)
+    {
+        if (context > conf -> maxcontext) context = conf -> maxcontext;
+        ok = bench_context (conf, fname, wbuffer, bytes, nsyms, context, conf -> alphabet ? &alpha : NULL,
+                           model_fname);
+        if (context == conf -> maxcontext) break;
+    }
+
+    wAlpha_free (&alpha);
+    free (wbuffer);
+    return ok;
+}
+
+int main (int argc, char* argv[])
+{
+    setlocale (LC_ALL, "en_US.utf-8");
+
+    struct bench_conf conf;
+    conf.seed       = 1;
+    conf.maxcontext = 8;
+    conf.reps       = 3;
+    conf.length     = 1 << 24;
+    conf.alphabet   = 1;
+    conf.tmpdir     = getenv ("TMPDIR") ? getenv ("TMPDIR") : "/tmp";
+    long THREADS    = sysconf (_SC_NPROCESSORS_ONLN);
+    size_t SIZE     = 8 << 20;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* opt = argv[i];
+        if (strncmp (opt, "--", 2) != 0) continue;
+        if (i + 1 >= argc) _FAIL (BADARGS);
+
+        const char* arg = argv[i + 1];
+        char* end = NULL;
+        unsigned long long value = strtoull (arg, &end, 0);
+        int number = *arg && !*end;
+        if      (strcmp (opt, "--seed")     == 0 && number) conf.seed       = value;
+        else if (strcmp (opt, "--threads")  == 0 && number) THREADS         = (long)value;
+        else if (strcmp (opt, "--context")  == 0 && number) conf.maxcontext = value;
+        else if (strcmp (opt, "--reps")     == 0 && number) conf.reps       = value;
+        else if (strcmp (opt, "--length")   == 0 && number) conf.length     = value;
+        else if (strcmp (opt, "--size")     == 0 && number) SIZE            = value;
+        else if (strcmp (opt, "--alphabet") == 0 && number) conf.alphabet   = value != 0;
+        else if (strcmp (opt, "--tmp")      == 0)           conf.tmpdir     = arg;
+        else _FAIL (BADARGS);
+
+        memmove (argv + i, argv + i + 2, (argc - i - 1) * sizeof (char*));
+        argc -= 2;
+        i--;
+    }
+    if (THREADS < 1) THREADS = 1;
+    conf.threads = (unsigned)THREADS;
+    if (!conf.maxcontext || !conf.reps || !conf.length || !SIZE) _FAIL (BADARGS);
+
+    char synth_fname[4096];
+    char model_fname[4096];
+    snprintf (synth_fname, sizeof (synth_fname), "%s/markflow-bench-%ld.txt", conf.tmpdir, (long)getpid ());
+    snprintf (model_fname, sizeof (model_fname), "%s/markflow-bench-%ld.model", conf.tmpdir, (long)getpid ());
+
+    int ok = 1;
+    if (argc < 2)
+    {
+        if (!bench_synth (synth_fname, SIZE, conf.seed)) _FAIL (NOSYNTH);
+        ok = bench_corpus (&conf, synth_fname, model_fname);
+        unlink (synth_fname);
+    }
+    for (int i = 1; ok && i < argc; i++)
+        ok = bench_corpus (&conf, argv[i], model_fname);
+
+    if (!ok) _FAIL (NOBENCH);
+
+    return 0;
+
+//========[ ERRONEOUS TERMINATION ]========
+
+BADARGS:
+    printf ("Usage: %s [options] [<input file>...]\n", argv [0]);
+    printf ("Runs every benchmark on the input files, or on a synthetic corpus if none are given.\n");
+    printf ("Options: --seed <n>      seed of the synthetic corpus, of sampling and of generation\n");
+    printf ("         --size <n>      size of the synthetic corpus in bytes\n");
+    printf ("         --threads <n>   number of threads to train on in parallel\n");
+    printf ("         --context <n>   longest context length, from 1 doubling up to it\n");
+    printf ("         --reps <n>      repetitions of every measurement, the best is reported\n");
+    printf ("         --length <n>    number of symbols to generate\n");
+    printf ("         --tmp <dir>     directory for the synthetic corpus and models\n");
+    printf ("         --alphabet <n>  0 to train on code points instead of IDs of the alphabet\n");
+    return 1;
+
+NOSYNTH:
+    fprintf (stderr, "%s: cannot write the synthetic corpus to %s (error %d)\n", argv [0], synth_fname, errno);
+    return 1;
+
+NOBENCH:
+    fprintf (stderr, "%s: benchmark failed (error %d)\n", argv [0], errno);
+    unlink (model_fname);
+    return 1;
+}
@@ -6,115 +6,313 @@
 #include <string.h>
 #include <errno.h>
 #include <locale.h>
+#include <limits.h>
 #include "wtrie.h"
 #include "wsnippets.h"
-#include <math.h>
+#include "wmarkov.h"
+#include "whash.h"
+#include "wfrozen.h"
+#include "wrandom.h"
+#include "wstats.h"
 #include <time.h>
 
 #define _FAIL(X) goto X
 
-int main (int argc, char* argv[])
+/** @brief Trains a model on the given file with up to THREADS threads with BACKEND and freezes it.
+ *
+ * Symbols are numbered by their frequency in the file first, see wMarkov_alphabet. With a single thread
+ * the file is then streamed in chunks, so memory use depends on the size of the model, not of the file. If
+ * COUNTS_IN is not NULL, training goes on from the count model saved there, whose length of contexts is
+ * used instead of CONTEXT, as if its text were followed by the file. If COUNTS_OUT is not NULL, the count
+ * model is saved there afterwards, see wMarkov_save. If MINCOUNT or TOPK is not 0, the model is
+ * pruned before that, see wMarkov_prune, and what was removed is reported to standard error. If LINES is
+ * set, lines of the file are trained as separate documents, see wMarkov_trainer_lines; a count model
+ * trained so goes on so without it. If MEMORY is not 0, the hash backend counts in that many bytes at most,
+ * spilling sorted runs of counts to disk past them, see wHash_spill. Every step is timed for --stats, see
+ * wStats_lap.
+ *
+ * @return NULL if fails, pointer to the frozen model otherwise.
+ */
+
+struct wFrozen* train (const char* in_fname, unsigned CONTEXT, unsigned THREADS, const char* COUNTS_IN,
+                       const char* COUNTS_OUT, unsigned long MINCOUNT, unsigned TOPK, int LINES,
+                       size_t MEMORY, const struct wMarkov_backend* BACKEND)
 {
-    setlocale (LC_ALL, "en_US.utf-8");
+    double t = wStats_now ();
+    struct wTrie_pool pool;
+    wTrie_pool_init (&pool, 0);
+    struct wFrozen* FZ = NULL;
 
-    if (argc < 4) _FAIL (BADARGS);
+    struct wMarkov_trainer trainer;
+    struct wAlpha alpha;
+    wAlpha_init (&alpha);
+    struct wTrie* WT = COUNTS_IN ? NULL : wTrie_pool_node (&pool, L'\0', 0, NULL, 0);
+    int ok = COUNTS_IN ? wMarkov_load (&trainer, &pool, &alpha, COUNTS_IN)
+                       : WT && wMarkov_trainer_init (&trainer, &pool, WT, CONTEXT);
+    if (ok && !COUNTS_IN) trainer.alpha = &alpha;
+    trainer.budget = MEMORY;
+    ok = ok && (!LINES || wMarkov_trainer_lines (&trainer));
+    t = wStats_lap (WSTATS_LOAD, t);
 
-    unsigned CONTEXT = strtoul (argv[1], NULL, 10);
-    unsigned TLENGTH = strtoul (argv[2], NULL, 10);
-    const char* in_fname      = argv[3];
+    ok = ok && (!trainer.alpha || wMarkov_alphabet (&alpha, in_fname));
+    t = wStats_lap (WSTATS_ALPHABET, t);
+    ok = ok && BACKEND -> train (&trainer, in_fname, THREADS);
+    t = wStats_lap (WSTATS_TRAIN, t);
 
-    if ( !(TLENGTH && CONTEXT && in_fname) ) _FAIL (BADARGS);
+    struct wMarkov_pruned pruned;
+    if (ok && (MINCOUNT || TOPK))
+    {
+        ok = wMarkov_prune (&trainer, MINCOUNT, TOPK, &pruned);
+        if (ok) fprintf (stderr, "pruned %zu transitions, %zu nodes, %zu bytes\n",
+                         pruned.edges, pruned.nodes, pruned.bytes);
+    }
+    t = wStats_lap (WSTATS_PRUNE, t);
 
-    struct wTrie* WT = calloc (1, sizeof (struct wTrie));
-    wTrie_init (WT, L'\0', 0, NULL, 0);
+    ok = ok && (!COUNTS_OUT || wMarkov_save (&trainer, COUNTS_OUT));
+    t = wStats_lap (WSTATS_SAVE, t);
+    if (ok) FZ = wFrozen_freeze (trainer.root, trainer.start, trainer.context, trainer.alpha);
+    wStats_lap (WSTATS_FREEZE, t);
 
-    wchar_t* wbuffer = wloadfile (in_fname, NULL);
-    wchar_t* wbufpos = wbuffer;
-    wchar_t* word = calloc (CONTEXT + 1, sizeof (wchar_t));
+    wTrie_pool_free (&pool);
+    wAlpha_free (&alpha);
+    return FZ;
+}
 
-    struct wTrie* endnode = NULL;
-    struct wTrie* newborn = NULL;
-    struct wTrie* child = NULL;
-    int nletters = 0;
-    float fnum = 0.0;
+/** @brief Writes TLENGTH characters generated by the model from SEED to standard output.
+ *
+ * If DOCS is not 0, generates that many documents of TLENGTH characters each on THREADS threads instead, to
+ * files named OUT, index, ".txt", or to standard output framed if OUT is NULL, see wFrozen_batch.
+ *
+ * @return 0 if fails to write, 1 otherwise.
+ */
 
-    for (wbufpos; *(wbufpos + CONTEXT + 2) != L'\0'; wbufpos++)
+int generate (const struct wFrozen* FZ, unsigned TLENGTH, uint64_t SEED, size_t DOCS, const char* OUT,
+              unsigned THREADS)
+{
+    double t = wStats_now ();
+    if (DOCS)
     {
-        wcsncpy (word, wbufpos, CONTEXT);
-        endnode = wTrie_findword (WT, word);
-        if (!endnode) endnode = wTrie_addword (WT, word);
-        child = wTrie_child (endnode, *(wbufpos + CONTEXT), NULL);
-        if (!child)
-        {
-            newborn = wTrie_spawn (1, endnode, *(wbufpos + CONTEXT), 0, NULL, sizeof (float));
-            *(float*)(newborn -> meta) = (float)1.0;
-        }
-        else
-        {
-            (*(float*)(child -> meta)) += (float)1.0;
-        }
+        int ok = wFrozen_batch (FZ, SEED, DOCS, TLENGTH, OUT, STDOUT_FILENO, THREADS);
+        wStats_lap (WSTATS_GENERATE, t);
+        return ok;
+    }
 
-        nletters = 0;
-        for (child = endnode -> child; child; child = child -> sibling)
+    struct wRandom rng;
+    struct wOutbuf out;
+    wRandom_seed (&rng, SEED);
+    if (!wOutbuf_fd (&out, STDOUT_FILENO, 0)) return 0;
+    wFrozen_walk (FZ, &rng, TLENGTH, &out);
+    int ok = wOutbuf_close (&out);
+    wStats_lap (WSTATS_GENERATE, t);
+    return ok;
+}
+
+/** @brief Replaces the model FZ by its packed copy, see wFrozen_pack. The time is counted as freezing.
+ *
+ * @return NULL if fails, freeing FZ, pointer to the packed model otherwise.
+ */
+
+struct wFrozen* pack (struct wFrozen* FZ)
+{
+    double t = wStats_now ();
+    struct wFrozen* PK = wFrozen_pack (FZ);
+    wFrozen_free (FZ);
+    wStats_lap (WSTATS_FREEZE, t);
+    return PK;
+}
+
+/** @brief Writes counters and times of phases of the run as JSON to the file STATS, see wStats_json.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int stats (const char* STATS)
+{
+    FILE* file = fopen (STATS, "w");
+    if (!file) return 0;
+    int ok = wStats_json (file);
+    return (fclose (file) == 0) && ok;
+}
+
+/** @brief Backends of training selectable with --backend, the first one is the default. */
+
+const struct wMarkov_backend* BACKENDS[] = { &wMarkov_trie, &wHash_backend };
+
+int main (int argc, char* argv[])
+{
+    setlocale (LC_ALL, "en_US.utf-8");
+
+    uint64_t SEED = (uint64_t)time (NULL);
+    long THREADS = sysconf (_SC_NPROCESSORS_ONLN);
+    if (THREADS < 1) THREADS = 1;
+    size_t DOCS = 0;
+    const char* OUT = NULL;
+    const char* COUNTS = NULL;
+    const char* STATS = NULL;
+    unsigned long MINCOUNT = 0;
+    unsigned TOPK = 0;
+    long ORDER = -1;
+    int LINES = 0;
+    int PACKED = 0;
+    size_t MEMORY = 0;
+    const struct wMarkov_backend* BACKEND = BACKENDS[0];
+    for (int i = 1; i < argc; i++)
+    {
+        const char* opt = argv[i];
+        if (strncmp (opt, "--", 2) != 0) continue;
+        if (strcmp (opt, "--lines") == 0 || strcmp (opt, "--packed") == 0)
         {
-            nletters += (int)*(float*)(child -> meta);
+            if (opt[2] == 'l') LINES = 1;
+            else PACKED = 1;
+            memmove (argv + i, argv + i + 1, (argc - i) * sizeof (char*));
+            argc--;
+            i--;
+            continue;
         }
-        for (child = endnode -> child; child; child = child -> sibling)
+        if (i + 1 >= argc) _FAIL (BADARGS);
+
+        const char* arg = argv[i + 1];
+        char* end = NULL;
+        unsigned long long value = strtoull (arg, &end, 0);
+        int number = *arg && !*end;
+        if      (strcmp (opt, "--seed")      == 0 && number) SEED     = value;
+        else if (strcmp (opt, "--threads")   == 0 && number && value <= UINT_MAX) THREADS = (long)value;
+        else if (strcmp (opt, "--docs")      == 0 && number) DOCS     = value;
+        else if (strcmp (opt, "--out")       == 0)           OUT      = arg;
+        else if (strcmp (opt, "--counts")    == 0)           COUNTS   = arg;
+        else if (strcmp (opt, "--stats")     == 0)           STATS    = arg;
+        else if (strcmp (opt, "--min-count") == 0 && number) MINCOUNT = value;
+        else if (strcmp (opt, "--top-k")     == 0 && number && value <= UINT_MAX) TOPK    = (unsigned)value;
+        else if (strcmp (opt, "--order")     == 0 && number && value <= UINT_MAX) ORDER   = (long)value;
+        else if (strcmp (opt, "--memory")    == 0 && number && value && value < (SIZE_MAX >> 20))
+            MEMORY = (size_t)value << 20;
+        else if (strcmp (opt, "--backend")   == 0)
         {
-            fnum = *(float*)(child -> meta);
-            *(float*)(child -> meta) = (float)(int)fnum + (float)(int)fnum / (float)nletters;
+            BACKEND = NULL;
+            for (size_t b = 0; b < sizeof (BACKENDS) / sizeof (BACKENDS[0]); b++)
+                if (strcmp (arg, BACKENDS[b] -> name) == 0) BACKEND = BACKENDS[b];
+            if (!BACKEND) _FAIL (BADARGS);
         }
+        else _FAIL (BADARGS);
+
+        memmove (argv + i, argv + i + 2, (argc - i - 1) * sizeof (char*));
+        argc -= 2;
+        i--;
     }
 
-    srand (time (NULL));
-    wchar_t* seed = calloc (CONTEXT + 1, sizeof (wchar_t));
-    wchar_t nwch = L'\0';
-    float rndf = 0.0; float rndacc = 0.0;
-    int i = 1; int j = 0;
-    wcsncpy (seed, wbuffer, CONTEXT);
-    seed [CONTEXT] = L'\0';
+    if (argc < 4 || THREADS < 1 || (MEMORY && BACKEND != &wHash_backend)) _FAIL (BADARGS);
+    if (OUT && !DOCS) DOCS = 1;
 
-    for (int i = 0; i < TLENGTH; i++)
+    unsigned CONTEXT = 0;
+    unsigned TLENGTH = 0;
+    const char* in_fname = NULL;
+    const char* model_fname = NULL;
+    struct wFrozen* FZ = NULL;
+
+    if (strcmp (argv[1], "train") == 0)
     {
-        endnode = wTrie_findword (WT, seed);
-        if (endnode)
-        {
-            rndf = (float)rand() / (float)((unsigned)RAND_MAX + 1);
-            rndacc = 0.0;
-            for (child = endnode -> child; child; child = child -> sibling)
-            {
-                rndacc += fmod (*(float*)(child -> meta), (float)1.0);
-                if (!rndacc || rndacc >= rndf)
-                {
-                    nwch = child -> wc;
-                    break;
-                }
-            }
-            wprintf (L"%lc", nwch);
-            for (int j = 0; j < CONTEXT; j++)
-            {
-                seed[j] = seed[j+1];
-            }
-            seed[CONTEXT-1] = nwch;
-        }
-        else
-        {
-            wcsncpy (seed, wbuffer, CONTEXT);
-        }
+        if (argc < 5) _FAIL (BADARGS);
+        CONTEXT     = strtoul (argv[2], NULL, 10);
+        in_fname    = argv[3];
+        model_fname = argv[4];
+        if (!CONTEXT) _FAIL (BADARGS);
+
+        FZ = train (in_fname, CONTEXT, (unsigned)THREADS, NULL, COUNTS, MINCOUNT, TOPK, LINES, MEMORY, BACKEND);
+        if (FZ && PACKED) FZ = pack (FZ);
+        if (!FZ) _FAIL (NOMODEL);
+        double t = wStats_now ();
+        if (!wFrozen_save (FZ, model_fname)) _FAIL (NOSAVE);
+        wStats_lap (WSTATS_SAVE, t);
+    }
+    else if (strcmp (argv[1], "update") == 0)
+    {
+        if (argc < 5) _FAIL (BADARGS);
+        const char* counts_fname = argv[2];
+        in_fname    = argv[3];
+        model_fname = argv[4];
+
+        FZ = train (in_fname, 0, (unsigned)THREADS, counts_fname, COUNTS ? COUNTS : counts_fname,
+                    MINCOUNT, TOPK, LINES, MEMORY, BACKEND);
+        if (FZ && PACKED) FZ = pack (FZ);
+        if (!FZ) _FAIL (NOMODEL);
+        double t = wStats_now ();
+        if (!wFrozen_save (FZ, model_fname)) _FAIL (NOSAVE);
+        wStats_lap (WSTATS_SAVE, t);
+    }
+    else if (strcmp (argv[1], "generate") == 0)
+    {
+        model_fname = argv[2];
+        TLENGTH     = strtoul (argv[3], NULL, 10);
+        if (!TLENGTH) _FAIL (BADARGS);
+
+        double t = wStats_now ();
+        FZ = wFrozen_load (model_fname);
+        if (!FZ) _FAIL (NOLOAD);
+        wStats_lap (WSTATS_LOAD, t);
+        if (ORDER >= 0 && ORDER < FZ -> context) FZ -> maxorder = (unsigned)ORDER;
+        if (!generate (FZ, TLENGTH, SEED, DOCS, OUT, (unsigned)THREADS)) _FAIL (NOWRITE);
+    }
+    else
+    {
+        CONTEXT  = strtoul (argv[1], NULL, 10);
+        TLENGTH  = strtoul (argv[2], NULL, 10);
+        in_fname = argv[3];
+        if ( !(TLENGTH && CONTEXT && in_fname) ) _FAIL (BADARGS);
+
+        FZ = train (in_fname, CONTEXT, (unsigned)THREADS, NULL, NULL, MINCOUNT, TOPK, LINES, MEMORY, BACKEND);
+        if (FZ && PACKED) FZ = pack (FZ);
+        if (!FZ) _FAIL (NOMODEL);
+        if (ORDER >= 0 && ORDER < FZ -> context) FZ -> maxorder = (unsigned)ORDER;
+        if (!generate (FZ, TLENGTH, SEED, DOCS, OUT, (unsigned)THREADS)) _FAIL (NOWRITE);
     }
 
-    //wTrie_dump (WT);
-     
-    wTrie_purge (WT);
-    free (wbuffer);
-    free (word);
+    wFrozen_free (FZ);
+    if (STATS && !stats (STATS)) _FAIL (NOSTATS);
 
     return 0;
 
 //========[ ERRONEOUS TERMINATION ]========
 
 BADARGS:
-    printf ("Usage: %s <context length> <output length> <input file>\n", argv [0]);
+    printf ("Usage: %s [options] <context length> <output length> <input file>\n", argv [0]);
+    printf ("       %s train [options] <context length> <input file> <model file>\n", argv [0]);
+    printf ("       %s update [options] <counts file> <input file> <model file>\n", argv [0]);
+    printf ("       %s generate [options] <model file> <output length>\n", argv [0]);
+    printf ("Options: --seed <n>      seed of the random generator\n");
+    printf ("         --threads <n>   number of threads to train and generate on\n");
+    printf ("         --docs <n>      generate n documents of the output length each, framed\n");
+    printf ("         --out <prefix>  write documents to files <prefix><index>.txt instead\n");
+    printf ("         --counts <file> save the count model to the file, to update it later\n");
+    printf ("         --stats <file>  write counters and times of phases of the run to the file as JSON\n");
+    printf ("         --min-count <n> prune transitions met less than n times\n");
+    printf ("         --top-k <n>     keep only n most frequent transitions of every context\n");
+    printf ("         --order <n>     generate from contexts of at most n symbols\n");
+    printf ("         --backend <b>   count transitions in a trie or a hash table: trie, hash\n");
+    printf ("         --memory <MB>   with --backend hash, spill counts to disk once the hash table takes\n");
+    printf ("                         n MB; only the table is capped, not the trie and model built from it\n");
+    printf ("         --lines         train on every line as a separate document, generate whole lines\n");
+    printf ("         --packed        pack the model: 16-bit probabilities, bit-packed edges\n");
+    return 1;
+
+NOMODEL:
+    fprintf (stderr, "%s: cannot build a model of %s (error %d)\n", argv [0], in_fname, errno);
+    return 1;
+
+NOSAVE:
+    fprintf (stderr, "%s: cannot save the model to %s (error %d)\n", argv [0], model_fname, errno);
+    wFrozen_free (FZ);
+    return 1;
+
+NOLOAD:
+    fprintf (stderr, "%s: cannot load the model from %s (error %d)\n", argv [0], model_fname, errno);
+    return 1;
 
+NOSTATS:
+    fprintf (stderr, "%s: cannot write the stats to %s (error %d)\n", argv [0], STATS, errno);
+    return 1;
 
+NOWRITE:
+    fprintf (stderr, "%s: cannot write the output (error %d)\n", argv [0], errno);
+    wFrozen_free (FZ);
+    return 1;
 }
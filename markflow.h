@@ -0,0 +1,125 @@
+/**
+ * @file markflow.h
+ * @brief Interface for generating text from models within a process of one's own
+ *
+ * A model is loaded once with wFrozen_load, shared by every thread of the process and freed with
+ * wFrozen_free once they are done with it. Text is generated by generators, one per request or per
+ * thread: a wGen is a few words on the stack or anywhere the caller likes, set up with wGen_init from a
+ * seed and an optional context to go on from, and may be set up again for the next request. Generating
+ * only reads the model, so any number of generators can run at once on one model without locks, see
+ * wfrozen.h.
+ *
+ * A generator set up without a context generates exactly what the command line tool does with the same
+ * seed and model.
+ */
+
+#ifndef _MARKFLOW_H_
+#define _MARKFLOW_H_
+
+// Models are frozen with qsort_r; this only takes if the header comes before any system header
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <wchar.h>
+#include "wfrozen.h"
+#include "wrandom.h"
+
+/** @brief State of generation from a shared model. */
+
+struct wGen
+{
+    const struct wFrozen* fz;   //!< The model.
+    struct wRandom rng;         //!< Random generator.
+    uint32_t       state;       //!< State of the model the next symbol is generated from.
+    unsigned       maxorder;    //!< Length of the longest contexts used, the model's unless lowered.
+};
+
+/** @brief Service function moving @c gen -> state on by the symbol @b wch, as if it had been generated.
+ *
+ * Generation goes on from the longest suffix of the text so far followed by @b wch which is a context of
+ * the model, or from the empty context if @b wch never follows any of them. A newline ends the document
+ * in a model of documents.
+ */
+
+void wGen_push (struct wGen* gen, wchar_t wch)
+{
+    const struct wFrozen* fz = gen -> fz;
+    if (wFrozen_docs (fz) && wch == fz -> alpha[0])
+    {
+        gen -> state = fz -> start;
+        return;
+    }
+
+    for (uint32_t s = gen -> state; s != WFROZEN_NONE; s = fz -> back[s])
+        for (uint32_t e = fz -> offs[s]; e < fz -> offs[s + 1]; e++)
+            if (wFrozen_sym (fz, e) && fz -> alpha[wFrozen_sym (fz, e)] == wch)
+            {
+                gen -> state = wFrozen_next (fz, e);
+                return;
+            }
+    gen -> state = 0;
+}
+
+/** @brief Constructor of generators. Should ALWAYS be called before generating, and may be called again
+ * to reuse the generator.
+ *
+ * The generator is seeded with @b seed, see wRandom_seed. If @b context is not empty, generation goes on
+ * from the text it holds, from the start of a document in a model of documents, and goes from the start
+ * state of the model otherwise, like wFrozen_walk does. Symbols of the context missing from the model are
+ * skipped over by backing off, see wGen_push. Generation is limited to the orders of the model set with
+ * @c fz -> maxorder, which @c gen -> maxorder may lower afterwards.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wGen_init (struct wGen* gen, const struct wFrozen* fz, uint64_t seed, const wchar_t* context)
+{
+    _PRECONDITION_CHEAP ((gen && fz), E_WTRIE_NULLPOINTER, return 0);
+
+    gen -> fz       = fz;
+    // State 0 is the empty context, see wFrozen_freeze
+    gen -> state    = (context && *context && !wFrozen_docs (fz)) ? 0 : fz -> start;
+    gen -> maxorder = fz -> maxorder;
+    wRandom_seed (&gen -> rng, seed);
+    for (; fz -> nstates && context && *context; context++) wGen_push (gen, *context);
+    return 1;
+}
+
+/** @brief Generates @b n characters into @b buff, with the newlines between documents of a model of them.
+ *
+ * @return Number of characters generated, @b n unless the model is empty.
+ */
+
+size_t wGen_text (struct wGen* gen, wchar_t* buff, size_t n)
+{
+    _PRECONDITION_CHEAP ((gen && (buff || !n)), E_WTRIE_NULLPOINTER, return 0);
+
+    const struct wFrozen* fz = gen -> fz;
+    if (!fz -> nstates) return 0;
+    for (size_t i = 0; i < n; i++)
+        buff[i] = fz -> alpha[wFrozen_step (fz, &gen -> state, gen -> maxorder, &gen -> rng)];
+    return n;
+}
+
+/** @brief Generates characters into @b buff as UTF-8, until fewer bytes than a character may take are left
+ * of @b size. Nothing is left over for the next call, so calls may go on with buffers of any size.
+ *
+ * @return Number of bytes written, not followed by a null.
+ */
+
+size_t wGen_utf8 (struct wGen* gen, char* buff, size_t size)
+{
+    _PRECONDITION_CHEAP ((gen && (buff || !size)), E_WTRIE_NULLPOINTER, return 0);
+
+    const struct wFrozen* fz = gen -> fz;
+    struct wOutbuf out;
+    wOutbuf_mem (&out, buff, size);
+    while (fz -> nstates && out.len + 4 <= size)
+        wOutbuf_put (&out, fz -> alpha[wFrozen_step (fz, &gen -> state, gen -> maxorder, &gen -> rng)]);
+    return out.len;
+}
+
+#endif
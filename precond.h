@@ -2,6 +2,32 @@
 #define _PRECOND_H_
 #include <errno.h>
 
+/**
+ * @file precond.h
+ * @brief Checks of preconditions which set errno and take an action, such as returning, if they fail
+ *
+ * Checks come in three kinds. _PRECONDITION checks conditions which may fail at run time whatever the
+ * caller does, such as a file which could not be opened, and is always compiled in. _PRECONDITION_CHEAP
+ * checks arguments which only a bug of the caller makes invalid, such as NULL pointers, in O(1) time,
+ * and _PRECONDITION_FULL validates whole data structures, such as a tree with wTrie_rOK, which may take
+ * time proportional to their size. Which of the last two are compiled in is selected by PRECOND_LEVEL:
+ * PRECOND_OFF compiles out both, PRECOND_CHEAP keeps cheap checks only, PRECOND_FULL keeps both. The
+ * level defaults to PRECOND_OFF if NDEBUG is defined and to PRECOND_FULL otherwise. Passing invalid
+ * arguments with checks compiled out is undefined behavior.
+ */
+
+#define PRECOND_OFF   0     //!< Only checks of run time failures.
+#define PRECOND_CHEAP 1     //!< Also O(1) checks of arguments.
+#define PRECOND_FULL  2     //!< Also validation of whole data structures.
+
+#ifndef PRECOND_LEVEL
+#ifdef NDEBUG
+#define PRECOND_LEVEL PRECOND_OFF
+#else
+#define PRECOND_LEVEL PRECOND_FULL
+#endif
+#endif
+
 #define _PRECONDITION(eval, seterr, action)                          \
     if (!(eval))                                                    \
     {                                                               \
@@ -9,4 +35,16 @@
         action;                                                     \
     }                                                               \
 
+#if PRECOND_LEVEL >= PRECOND_CHEAP
+#define _PRECONDITION_CHEAP(eval, seterr, action) _PRECONDITION (eval, seterr, action)
+#else
+#define _PRECONDITION_CHEAP(eval, seterr, action)
+#endif
+
+#if PRECOND_LEVEL >= PRECOND_FULL
+#define _PRECONDITION_FULL(eval, seterr, action) _PRECONDITION (eval, seterr, action)
+#else
+#define _PRECONDITION_FULL(eval, seterr, action)
+#endif
+
 #endif
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Checks that framed documents from --docs are exactly the files written with --out, on a model of lines
+# of multibyte symbols, whose documents run past the requested length to the end of a line.
+#
+# Usage: sh tests/framed.sh [<markflow binary>], checks main.c built into a temporary directory if none is
+# given. Either way main.c and bench.c are built with -Wall -Wextra first.
+
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$(dirname "$0")/.."
+
+# Builds with warnings on and fails on any but the known ones of the string snippets in wsnippets.h
+for src in main.c bench.c; do
+    gcc -O2 -Wall -Wextra -pthread $src -o "$dir/${src%.c}" 2> "$dir/warnings"
+    if grep 'warning:' "$dir/warnings" | grep -v '^wsnippets\.h:' > /dev/null; then
+        cat "$dir/warnings"
+        echo "framed.sh: $src builds with new warnings"
+        exit 1
+    fi
+done
+bin=${1:-"$dir/main"}
+
+# Lines of 5 to 60 CJK symbols, 3 bytes each in UTF-8
+LC_ALL=C awk 'BEGIN {
+    srand (3);
+    cjk = "一丁七万丈三上下不与丐丑专且丕世丘丙业丛东丝丞丢两严並丧丨个丫中丰串临丶丸丹为主丼丽举";
+    for (i = 0; i < 3000; i++)
+    {
+        n = 5 + int (rand () * 56);
+        line = "";
+        for (k = 0; k < n; k++) line = line substr (cjk, 1 + 3 * int (rand () * 40), 3);
+        print line;
+    }
+}' > "$dir/cjk.txt"
+
+"$bin" --lines train 3 "$dir/cjk.txt" "$dir/cjk.fz" > /dev/null
+
+docs=16
+for seed in 1 7 42; do
+    for length in 1 20 200; do
+        rm -f "$dir"/doc*.txt "$dir/expected"
+        "$bin" --seed $seed --docs $docs generate "$dir/cjk.fz" $length > "$dir/framed"
+        "$bin" --seed $seed --docs $docs --out "$dir/doc" generate "$dir/cjk.fz" $length
+        i=0
+        while [ $i -lt $docs ]; do
+            printf '#markflow %d %d\n' $i $(wc -c < "$dir/doc$i.txt") >> "$dir/expected"
+            cat "$dir/doc$i.txt" >> "$dir/expected"
+            i=$((i + 1))
+        done
+        if ! cmp -s "$dir/framed" "$dir/expected"; then
+            echo "framed.sh: framed output differs from --out, seed $seed, length $length"
+            exit 1
+        fi
+    done
+done
+echo "framed.sh: ok"
@@ -0,0 +1,127 @@
+/**
+ * @file walpha.h
+ * @brief Alphabet of a text: dense symbol IDs for code points
+ *
+ * Texts use a few hundred distinct code points at most, scattered over the whole range of Unicode. A
+ * wAlpha numbers them from 1, so models can hold small dense IDs instead: children of trie nodes then span
+ * narrow ranges of symbols, which get direct-indexed tables (see wTrie_table), and frozen models store
+ * symbols of edges in 16 bits. ID 0 is never given to a code point, it marks boundaries of documents
+ * instead, see wMarkov_trainer_lines.
+ *
+ * IDs of code points are looked up in a two-level table of pages of WALPHA_PAGE code points, allocated
+ * only for pages which have symbols of the alphabet, so a lookup is two loads and the table stays a few
+ * kilobytes for most texts. Looking up never changes the alphabet, so any number of threads can map
+ * symbols with it at once.
+ */
+
+#ifndef _WALPHA_H_
+#define _WALPHA_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "wtrerrno.h"
+#include "precond.h"
+
+#define WALPHA_CODES 0x110000                       //!< Number of code points.
+#define WALPHA_SHIFT 8                              //!< Binary logarithm of the size of pages.
+#define WALPHA_PAGE  (1 << WALPHA_SHIFT)            //!< Number of code points of a page.
+#define WALPHA_PAGES (WALPHA_CODES >> WALPHA_SHIFT) //!< Number of pages.
+#define WALPHA_BOUNDARY 0                           //!< ID of no code point, the boundary of documents.
+
+struct wAlpha
+{
+    uint32_t  n;                    //!< Number of symbols, their IDs are 1 to n.
+    uint32_t  cap;                  //!< Capacity of @c code.
+    wchar_t*  code;                 //!< Code point of each ID, @c code[0] is 0.
+    uint32_t* pages[WALPHA_PAGES];  //!< IDs of code points by pages, NULL for pages without symbols.
+};
+
+/** @brief Constructor of empty alphabets. Should ALWAYS be called after creating a wAlpha. */
+
+void wAlpha_init (struct wAlpha* alpha)
+{
+    memset (alpha, 0, sizeof (struct wAlpha));
+}
+
+/** @brief Frees the memory of the alphabet and leaves it empty. */
+
+void wAlpha_free (struct wAlpha* alpha)
+{
+    if (!alpha) return;
+    for (unsigned p = 0; p < WALPHA_PAGES; p++) free (alpha -> pages[p]);
+    free (alpha -> code);
+    wAlpha_init (alpha);
+}
+
+/** @brief Returns the ID of the code point @b wch, 0 if it is not in the alphabet. */
+
+static inline uint32_t wAlpha_id (const struct wAlpha* alpha, wchar_t wch)
+{
+    uint32_t code = (uint32_t)wch;
+    if (code >= WALPHA_CODES) return 0;
+    const uint32_t* page = alpha -> pages[code >> WALPHA_SHIFT];
+    return page ? page[code & (WALPHA_PAGE - 1)] : 0;
+}
+
+/** @brief Adds the code point @b wch to the alphabet under the next ID, if it is not there yet.
+ *
+ * @return The ID of the code point, 0 if fails.
+ */
+
+uint32_t wAlpha_add (struct wAlpha* alpha, wchar_t wch)
+{
+    _PRECONDITION_CHEAP (alpha, E_WTRIE_NULLPOINTER, return 0);
+
+    uint32_t code = (uint32_t)wch;
+    _PRECONDITION (code < WALPHA_CODES, E_WALPHA_BADCODE, return 0);
+
+    uint32_t id = wAlpha_id (alpha, wch);
+    if (id) return id;
+
+    uint32_t** page = alpha -> pages + (code >> WALPHA_SHIFT);
+    if (!*page) *page = calloc (WALPHA_PAGE, sizeof (uint32_t));
+    if (alpha -> n + 2 > alpha -> cap)
+    {
+        uint32_t cap = alpha -> cap ? 2 * alpha -> cap : 256;
+        wchar_t* grown = realloc (alpha -> code, cap * sizeof (wchar_t));
+        if (grown)
+        {
+            alpha -> code = grown;
+            alpha -> cap  = cap;
+        }
+    }
+    _PRECONDITION ((*page && alpha -> n + 2 <= alpha -> cap), E_WALPHA_NOMEM, return 0);
+
+    id = ++alpha -> n;
+    alpha -> code[0]  = L'\0';
+    alpha -> code[id] = wch;
+    (*page)[code & (WALPHA_PAGE - 1)] = id;
+    return id;
+}
+
+/** @brief Replaces the @b n code points at @b wbuff with their IDs in place, 0 for those not in the alphabet. */
+
+void wAlpha_map (const struct wAlpha* alpha, wchar_t* wbuff, size_t n)
+{
+    for (size_t i = 0; i < n; i++) wbuff[i] = (wchar_t)wAlpha_id (alpha, wbuff[i]);
+}
+
+/** @brief Replaces the @b n code points at @b wbuff with their IDs in place, adding those not in the alphabet.
+ *
+ * @return 0 if fails to add a code point, 1 otherwise.
+ */
+
+int wAlpha_mapadd (struct wAlpha* alpha, wchar_t* wbuff, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t id = wAlpha_id (alpha, wbuff[i]);
+        if (!id && !(id = wAlpha_add (alpha, wbuff[i]))) return 0;
+        wbuff[i] = (wchar_t)id;
+    }
+    return 1;
+}
+
+#endif
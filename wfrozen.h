@@ -0,0 +1,1272 @@
+/**
+ * @file wfrozen.h
+ * @brief Frozen read-only Markov model for generation
+ *
+ * A wFrozen is built once from a trained wTrie model (see wmarkov.h) and is never changed
+ * afterwards. Contexts become @b states numbered from 0, transitions become @b edges, stored in CSR
+ * layout: edges of state @c s are @c offs[s] to @c offs[s+1] - 1, sorted by symbol, with their
+ * symbols, alias tables and the states they lead to packed in flat arrays. Generation is a walk over
+ * states that needs no lookup by context at all: the state reached by an edge is the context
+ * made of the previous context without its first symbol plus the symbol of the edge, resolved once at
+ * freeze time through suffix links of the trie. Symbols of edges take 16 bits each, as indices into a
+ * table of the distinct code points of the model, so a model holds at most 65535 of them.
+ *
+ * The model is of variable order: every context of every length from 0 to the length of contexts of the
+ * trie is a state, with counts of transitions derived from those of the longest ones, see wFrozen_freeze.
+ * An edge leads to the longest context ending with its symbol which has transitions, so generation never
+ * runs into a dead end, backing off to shorter contexts and growing back as it goes. Every state also
+ * knows its order and the state of its longest shorter suffix, so generation may be limited to any order
+ * up to the length of contexts, see wFrozen::maxorder, and one model serves every order.
+ *
+ * Edges are picked in O(1) with Walker's alias method (see wFrozen_pick). The tables are built by Vose's
+ * algorithm in integers from transition counts, so every edge is picked with probability count / total
+ * exactly, up to the resolution of 64-bit random numbers.
+ *
+ * A frozen model can be saved to a binary file with wFrozen_save and mapped back into memory with
+ * wFrozen_load. The file holds the arrays exactly as they are laid out in memory, so loading involves no
+ * parsing and processes mapping the same model share its pages.
+ *
+ * A model trained on lines as documents (see wMarkov_trainer_lines) has edges to the end of a document,
+ * which lead back to the start state, so generated text is made of whole lines, see wFrozen_docs.
+ *
+ * A model is never changed while generating, so any number of threads can generate from it at once,
+ * each with a generator of its own, see wFrozen_batch.
+ *
+ * A model may be packed for deployment with wFrozen_pack: its alias tables are quantized to 16 bits and
+ * symbols and states of edges are packed to as many bits as they need, so it takes about a third less
+ * memory and file size, at the cost of probabilities being off by at most 2^-16 of each column.
+ */
+
+#ifndef _WFROZEN_H_
+#define _WFROZEN_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "wtrie.h"
+#include "wsnippets.h"
+#include "wrandom.h"
+#include "walpha.h"
+
+#define WFROZEN_NONE UINT32_MAX     //!< No state, such as the shorter suffix of the empty context.
+
+/** @brief Column of an alias table, one per edge. */
+
+struct wFrozen_col
+{
+    uint32_t prob;      //!< Weight in [0, total] of keeping the edge when its column is drawn.
+    uint32_t alias;     //!< Edge picked instead when it is not kept.
+};
+
+/** @brief Column of a quantized alias table of a packed model, see wFrozen_pack. */
+
+struct wFrozen_qcol
+{
+    uint16_t prob;      //!< Weight in [0, 65535] of keeping the edge, out of 65536.
+    uint16_t alias;     //!< Edge picked instead when it is not kept, from the first edge of the state.
+};
+
+struct wFrozen
+{
+    unsigned  context;  //!< Length of the longest contexts.
+    unsigned  maxorder; //!< Length of the longest contexts used for generation, @c context unless limited.
+    uint32_t  nstates;  //!< Number of states.
+    uint32_t  nedges;   //!< Number of edges.
+    uint32_t  start;    //!< State generation starts from.
+    uint32_t  nalpha;   //!< Number of distinct symbols of edges.
+    uint32_t* offs;     //!< First edge of each state, nstates + 1 items.
+    uint16_t* syms;     //!< Symbols of edges, as indices from 1 into @c alpha, 0 for ends of documents.
+    wchar_t*  alpha;    //!< Code point of each symbol of edges, nalpha + 1 items, see wFrozen_docs for @c alpha[0].
+    uint32_t* total;    //!< Sum of weights of edges of each state.
+    uint32_t* back;     //!< State of the longest shorter suffix of each state, WFROZEN_NONE for the empty one.
+    uint32_t* order;    //!< Length of the context of each state.
+    struct wFrozen_col* cols; //!< Alias tables of states, a column per edge.
+    uint32_t* next;     //!< States reached by edges.
+    struct wFrozen_qcol* qcols; //!< Alias tables of a packed model instead of @c cols and @c total, else NULL.
+    uint8_t*  psyms;    //!< Symbols of edges of a packed model instead of @c syms, @c symbits each.
+    uint8_t*  pnext;    //!< States reached by edges of a packed model instead of @c next, @c nextbits each.
+    unsigned  symbits;  //!< Width of symbols of edges of a packed model.
+    unsigned  nextbits; //!< Width of states reached by edges of a packed model.
+    void*     mem;      //!< Single allocation holding all of the arrays, or the mapped file.
+    size_t    mapsz;    //!< Size of the mapped file, 0 if the model is not mapped.
+};
+
+#define WFROZEN_MAGIC   "MARKFLOW"  //!< First bytes of model files.
+#define WFROZEN_VERSION 4           //!< Version of model files written by wFrozen_save.
+#define WFROZEN_PACKED  5           //!< Version of files of packed models.
+#define WFROZEN_ALIGN   64          //!< Alignment of arrays in model files.
+
+/** @brief Header of model files.
+ *
+ * Arrays follow the header at given offsets from the beginning of the file, in the native byte order
+ * and wchar_t size of the machine which saved the model, both of which are checked on loading. Files of
+ * packed models, of version WFROZEN_PACKED, have no totals, their columns are wFrozen_qcol, and states
+ * and symbols of edges are packed, see wFrozen_pack.
+ */
+
+struct wFrozen_header
+{
+    char     magic[8];  //!< WFROZEN_MAGIC without the terminating null.
+    uint32_t version;   //!< WFROZEN_VERSION.
+    uint32_t byteorder; //!< 0x01020304 as written by the saving machine.
+    uint32_t wcsize;    //!< sizeof (wchar_t) of the saving machine.
+    uint32_t context;   //!< Length of contexts.
+    uint32_t nstates;   //!< Number of states.
+    uint32_t nedges;    //!< Number of edges.
+    uint32_t start;     //!< Start state.
+    uint32_t nalpha;    //!< Number of distinct symbols of edges.
+    uint64_t offs;      //!< Offset of the array of first edges of states.
+    uint64_t next;      //!< Offset of the array of states reached by edges.
+    uint64_t syms;      //!< Offset of the array of symbols of edges.
+    uint64_t total;     //!< Offset of the array of total weights of states.
+    uint64_t cols;      //!< Offset of the array of alias table columns.
+    uint64_t back;      //!< Offset of the array of shorter suffixes of states.
+    uint64_t order;     //!< Offset of the array of orders of states.
+    uint64_t alpha;     //!< Offset of the array of code points of symbols of edges.
+    uint64_t size;      //!< Size of the whole file.
+};
+
+/** @brief Service function growing an array of nodes to hold at least @b need of them.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wFrozen_reserve (struct wTrie*** nodes, uint64_t* cap, uint64_t need)
+{
+    if (need <= *cap) return 1;
+
+    uint64_t size = *cap ? *cap : 1024;
+    while (size < need) size *= 2;
+    struct wTrie** grown = realloc (*nodes, size * sizeof (struct wTrie*));
+    if (!grown) return 0;
+    *nodes = grown;
+    *cap   = size;
+    return 1;
+}
+
+/** @brief Service function comparing nodes for qsort_r by the code points of their symbols in @c *alpha. */
+
+int wFrozen_codecmp (const void* a, const void* b, void* alpha)
+{
+    const wchar_t* code = (*(const struct wAlpha**)alpha) -> code;
+    wchar_t ia = (*(struct wTrie* const*)a) -> wc;
+    wchar_t ib = (*(struct wTrie* const*)b) -> wc;
+    wchar_t ca = code[ia];
+    wchar_t cb = code[ib];
+    // The boundary, ID 0, comes before the code point 0
+    return (ca != cb) ? (ca > cb) - (ca < cb) : (ia > ib) - (ia < ib);
+}
+
+/** @brief Service function collecting nodes of a trie model level by level, in order of their words
+ * within a level, down to contexts of @b context symbols and their transitions.
+ *
+ * Works breadth first with the array of nodes as its queue, so children of every node lie next to each
+ * other, in order of the node. Node @c i is at depth @c d if @c levels[d] <= i < @c levels[d+1], @b levels
+ * shall have @b context + 3 items. If @b alpha is not NULL, children are sorted by code points, so words
+ * are in the same order whatever IDs the symbols got.
+ *
+ * @return 0 if fails to grow the array, 1 otherwise.
+ */
+
+int wFrozen_levels (struct wTrie* root, unsigned context, const struct wAlpha* alpha, struct wTrie*** nodes,
+                    uint64_t* n, uint64_t* cap, uint64_t* levels)
+{
+    if (!wFrozen_reserve (nodes, cap, 1)) return 0;
+    (*nodes)[0] = root;
+    *n = 1;
+    levels[0] = 0;
+    for (unsigned d = 0; d <= context; d++)
+    {
+        levels[d + 1] = *n;
+        for (uint64_t i = levels[d]; i < levels[d + 1]; i++)
+        {
+            struct wTrie* wtr = (*nodes)[i];
+            if (!wFrozen_reserve (nodes, cap, *n + wtr -> nkids)) return 0;
+            for (unsigned j = 0; j < wtr -> nkids; j++) (*nodes)[*n + j] = wTrie_kid (wtr, j);
+            if (alpha && wtr -> nkids > 1)
+                qsort_r (*nodes + *n, wtr -> nkids, sizeof (struct wTrie*), wFrozen_codecmp, &alpha);
+            *n += wtr -> nkids;
+        }
+    }
+    levels[context + 2] = *n;
+    return 1;
+}
+
+/** @brief Map from trie nodes to their indices, an open addressing hash table keyed by node address. */
+
+struct wFrozen_map
+{
+    struct wTrie** nodes;   //!< Keys, NULL for empty slots.
+    uint32_t*      index;   //!< Values.
+    uint64_t       mask;    //!< Number of slots minus one, the number of slots is a power of 2.
+};
+
+/** @brief Service function hashing a node address into a slot of the map. */
+
+uint64_t wFrozen_slot (const struct wFrozen_map* map, struct wTrie* node)
+{
+    return ((uint64_t)(uintptr_t)node * 0x9E3779B97F4A7C15ull >> 17) & map -> mask;
+}
+
+/** @brief Builds the map for given nodes, numbering them in order.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wFrozen_mapinit (struct wFrozen_map* map, struct wTrie** nodes, uint64_t n)
+{
+    uint64_t size = 16;
+    while (size < 2 * n) size *= 2;
+    map -> mask  = size - 1;
+    map -> nodes = calloc (size, sizeof (struct wTrie*));
+    map -> index = malloc (size * sizeof (uint32_t));
+    if (!map -> nodes || !map -> index) return 0;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        uint64_t slot = wFrozen_slot (map, nodes[i]);
+        while (map -> nodes[slot]) slot = (slot + 1) & map -> mask;
+        map -> nodes[slot] = nodes[i];
+        map -> index[slot] = (uint32_t)i;
+    }
+    return 1;
+}
+
+/** @brief Service function mapping a trie node to its index.
+ *
+ * @return The index of the node, WFROZEN_NONE if the node is not in the map.
+ */
+
+uint32_t wFrozen_index (const struct wFrozen_map* map, struct wTrie* node)
+{
+    for (uint64_t slot = wFrozen_slot (map, node); map -> nodes[slot]; slot = (slot + 1) & map -> mask)
+        if (map -> nodes[slot] == node) return map -> index[slot];
+    return WFROZEN_NONE;
+}
+
+/** @brief Service function finding the state of the longest suffix of the word of @b node, itself included,
+ * which is a state, see wFrozen_freeze. @b state maps indices of nodes to their states.
+ *
+ * @return The state, WFROZEN_NONE if none of the suffixes is a state.
+ */
+
+uint32_t wFrozen_backoff (const struct wFrozen_map* map, const uint32_t* state, struct wTrie* node)
+{
+    for (; node; node = node -> suffix)
+    {
+        uint32_t idx = wFrozen_index (map, node);
+        if (idx != WFROZEN_NONE && state[idx] != WFROZEN_NONE) return state[idx];
+    }
+    return WFROZEN_NONE;
+}
+
+/** @brief Service function building the alias table of a state from @b counts of its @b k edges.
+ *
+ * Counts are scaled down if their sum does not fit in 32 bits, a state without counts gets uniform
+ * weights. @b w and @b work are scratch arrays of @b k items. Column @c j keeps @c prob of @c total and
+ * gives the rest to its @c alias: Vose's algorithm pairs up columns lighter than the average with heavier
+ * ones, comparing weights multiplied by @b k to the total so everything stays in integers.
+ * Columns of the state start at @b cols.
+ *
+ * @return Total weight of the state.
+ */
+
+uint32_t wFrozen_alias (uint32_t k, const uint64_t* counts, uint32_t base, struct wFrozen_col* cols, uint64_t* w,
+                        uint32_t* work)
+{
+    uint64_t total = 0;
+    for (unsigned shift = 0; shift < 64; shift++)
+    {
+        total = 0;
+        for (uint32_t i = 0; i < k; i++)
+        {
+            uint64_t count = counts[i] >> shift;
+            w[i] = count ? count : (shift > 0);
+            total += w[i];
+        }
+        if (total <= UINT32_MAX) break;
+    }
+    if (!total)
+    {
+        for (uint32_t i = 0; i < k; i++) w[i] = 1;
+        total = k;
+    }
+    for (uint32_t i = 0; i < k; i++) w[i] *= k;
+
+    // Light columns are stacked from the front of work, heavy ones from the back
+    uint32_t nlight = 0;
+    uint32_t heavy  = k;
+    for (uint32_t i = 0; i < k; i++)
+        if (w[i] < total) work[nlight++] = i;
+        else              work[--heavy]  = i;
+
+    while (nlight && heavy < k)
+    {
+        uint32_t lt = work[--nlight];
+        uint32_t hv = work[heavy];
+        cols[lt].prob  = (uint32_t)w[lt];
+        cols[lt].alias = base + hv;
+        w[hv] -= total - w[lt];
+        if (w[hv] < total)
+        {
+            heavy++;
+            work[nlight++] = hv;
+        }
+    }
+    // Weights left always sum up to total per column, so only columns of exactly the total are left
+    for (; heavy < k; heavy++)
+    {
+        cols[work[heavy]].prob  = (uint32_t)total;
+        cols[work[heavy]].alias = base + work[heavy];
+    }
+    return (uint32_t)total;
+}
+
+/** @brief Builds a frozen model from a trained trie model.
+ *
+ * Every node with transitions down to contexts of @b context symbols becomes a state, the root included as
+ * the empty context. The trie keeps counts of transitions of the longest contexts only; those of shorter
+ * ones are derived here: every occurrence of a word is an occurrence of its suffix, so counts are summed
+ * up along suffix links, deepest nodes first. Thus a position of the text contributes its context of
+ * every length, and a context of any length gets exactly the transitions which followed it.
+ *
+ * States are numbered by the lengths of their contexts, then in lexicographical order of them. An edge
+ * leads to its state's context with the symbol of the edge appended, without the first symbol if that
+ * would be too long, or to its longest suffix which is a state. Alias tables are built from counts, which
+ * are all the trie holds. If @b alpha is not NULL, symbols of the trie are IDs of its code points, see
+ * wMarkov_trainer::alpha. The trie must have been trained with suffix links (see wMarkov_trainer) and is
+ * not changed, so it can be freed right after freezing.
+ *
+ * @return NULL if fails, pointer to the new frozen model otherwise. @b start must be a context node of
+ * the model, an empty model is returned otherwise.
+ */
+
+struct wFrozen* wFrozen_freeze (struct wTrie* root, struct wTrie* start, unsigned context, const struct wAlpha* alpha)
+{
+    _PRECONDITION_CHEAP (root, E_WTRIE_NULLPOINTER, return NULL);
+
+    struct wFrozen* fz = NULL;
+    void* mem = NULL;
+    struct wTrie** nodes = NULL;
+    struct wFrozen_map map = { NULL, NULL, 0 };
+    uint64_t n = 0;
+    uint64_t cap = 0;
+    uint64_t nstates = 0;
+    uint64_t nedges = 0;
+    uint64_t* levels = malloc ((context + 3) * sizeof (uint64_t));
+    uint64_t* counts = NULL;
+    uint32_t* state = NULL;
+    uint64_t* weights = NULL;
+    uint64_t* w = NULL;
+    uint32_t* work = NULL;
+    uint32_t maxkids = 0;
+    struct wAlpha* dense = malloc (sizeof (struct wAlpha));
+    if (dense) wAlpha_init (dense);
+
+    if (!dense || !levels || !wFrozen_levels (root, context, alpha, &nodes, &n, &cap, levels)) goto NOMEM;
+    if (n >= WFROZEN_NONE)
+    {
+        free (levels);
+        free (nodes);
+        free (dense);
+        errno = E_WFROZEN_TOOBIG;
+        return NULL;
+    }
+
+    counts = malloc (n * sizeof (uint64_t));
+    state  = malloc (n * sizeof (uint32_t));
+    if (!counts || !state || !wFrozen_mapinit (&map, nodes, n)) goto NOMEM;
+
+    for (uint64_t i = 0; i < n; i++) counts[i] = nodes[i] -> count;
+    for (uint64_t i = n; i-- > levels[2]; )
+        if (nodes[i] -> suffix) counts[wFrozen_index (&map, nodes[i] -> suffix)] += counts[i];
+
+    // Children of node i are the nodes from kid on, see wFrozen_levels
+    uint64_t kid = 1;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        uint32_t k = 0;
+        unsigned nkids = (i < levels[context + 1]) ? nodes[i] -> nkids : 0;
+        for (unsigned j = 0; j < nkids; j++) k += counts[kid + j] != 0;
+        kid += nkids;
+
+        state[i] = k ? (uint32_t)nstates++ : WFROZEN_NONE;
+        nedges  += k;
+        if (k > maxkids) maxkids = k;
+    }
+    // Every node below the root with a count is an edge, see above
+    uint64_t sym = levels[1];
+    bool docs = false;
+    for (; sym < n; sym++)
+    {
+        if (!counts[sym]) continue;
+        if (alpha && nodes[sym] -> wc == WALPHA_BOUNDARY) docs = true;
+        else if (!wAlpha_add (dense, nodes[sym] -> wc)) break;
+    }
+    if (sym < n && errno == E_WALPHA_NOMEM) goto NOMEM;
+    if (sym < n || nstates >= WFROZEN_NONE || nedges >= WFROZEN_NONE || dense -> n > UINT16_MAX)
+    {
+        free (levels); free (nodes); free (counts); free (state); free (map.nodes); free (map.index);
+        wAlpha_free (dense); free (dense);
+        errno = E_WFROZEN_TOOBIG;
+        return NULL;
+    }
+
+    fz      = calloc (1, sizeof (struct wFrozen));
+    mem     = malloc (nedges * sizeof (struct wFrozen_col) + (4 * nstates + 1 + nedges) * sizeof (uint32_t) +
+                      (dense -> n + 1) * sizeof (wchar_t) + nedges * sizeof (uint16_t));
+    weights = malloc ((maxkids + 1) * sizeof (uint64_t));
+    w       = malloc ((maxkids + 1) * sizeof (uint64_t));
+    work    = malloc ((maxkids + 1) * sizeof (uint32_t));
+    if (!fz || !mem || !weights || !w || !work) goto NOMEM;
+
+    fz -> context  = context;
+    fz -> maxorder = context;
+    fz -> nstates  = (uint32_t)nstates;
+    fz -> nedges   = (uint32_t)nedges;
+    fz -> nalpha   = dense -> n;
+    fz -> mem      = mem;
+    fz -> cols     = mem;
+    fz -> offs     = (uint32_t*)(fz -> cols + nedges);
+    fz -> total    = fz -> offs + nstates + 1;
+    fz -> back     = fz -> total + nstates;
+    fz -> order    = fz -> back + nstates;
+    fz -> next     = fz -> order + nstates;
+    fz -> alpha    = (wchar_t*)(fz -> next + nedges);
+    fz -> syms     = (uint16_t*)(fz -> alpha + dense -> n + 1);
+
+    fz -> alpha[0] = docs ? L'\n' : L'\0';
+    for (uint32_t d = 1; d <= dense -> n; d++)
+        fz -> alpha[d] = alpha ? alpha -> code[dense -> code[d]] : dense -> code[d];
+
+    uint32_t e = 0;
+    unsigned depth = 0;
+    kid = 1;
+    for (uint64_t i = 0; i < levels[context + 1]; kid += nodes[i] -> nkids, i++)
+    {
+        while (i >= levels[depth + 1]) depth++;
+        uint32_t s = state[i];
+        if (s == WFROZEN_NONE) continue;
+
+        uint32_t k = 0;
+        fz -> offs[s] = e;
+        for (unsigned j = 0; j < nodes[i] -> nkids; j++)
+        {
+            if (!counts[kid + j]) continue;
+
+            struct wTrie* trans = nodes[kid + j];
+            bool end = alpha && trans -> wc == WALPHA_BOUNDARY;
+            fz -> syms[e + k] = end ? 0 : (uint16_t)wAlpha_id (dense, trans -> wc);
+            fz -> next[e + k] = wFrozen_backoff (&map, state, (depth < context) ? trans : trans -> suffix);
+            weights[k++] = counts[kid + j];
+        }
+        fz -> total[s] = wFrozen_alias (k, weights, e, fz -> cols + e, w, work);
+        fz -> back[s]  = wFrozen_backoff (&map, state, nodes[i] -> suffix);
+        fz -> order[s] = depth;
+        e += k;
+    }
+    fz -> offs[nstates] = e;
+
+    uint32_t first = start ? wFrozen_index (&map, start) : WFROZEN_NONE;
+    fz -> start = (first != WFROZEN_NONE) ? state[first] : WFROZEN_NONE;
+    if (fz -> start == WFROZEN_NONE) fz -> nstates = fz -> nedges = 0;
+
+    free (levels); free (nodes); free (counts); free (state); free (weights); free (w); free (work);
+    free (map.nodes); free (map.index); wAlpha_free (dense); free (dense);
+    return fz;
+
+NOMEM:
+    free (fz); free (mem); free (levels); free (nodes); free (counts); free (state); free (weights); free (w);
+    free (work); free (map.nodes); free (map.index); wAlpha_free (dense); free (dense);
+    errno = E_WFROZEN_NOMEM;
+    return NULL;
+}
+
+/** @brief Service function returning the number of bits needed to hold numbers up to @b max, 1 at least. */
+
+unsigned wFrozen_width (uint32_t max)
+{
+    unsigned width = 1;
+    while (width < 32 && (max >> width)) width++;
+    return width;
+}
+
+/** @brief Service function returning the bytes of an array of @b n numbers packed to @b width bits each,
+ * padded so any of them can be read with a single 64-bit load.
+ */
+
+uint64_t wFrozen_packsize (uint64_t n, unsigned width)
+{
+    return (n * width + 7) / 8 + sizeof (uint64_t);
+}
+
+/** @brief Service function writing @b value as number @b i of @b width bits of the packed array @b bits,
+ * which is zeroed beforehand.
+ */
+
+void wFrozen_setbits (uint8_t* bits, uint64_t i, unsigned width, uint32_t value)
+{
+    uint64_t bit = i * width;
+    uint64_t word;
+    memcpy (&word, bits + (bit >> 3), sizeof (word));
+    word |= (uint64_t)value << (bit & 7);
+    memcpy (bits + (bit >> 3), &word, sizeof (word));
+}
+
+/** @brief Service function reading number @b i of @b width bits of the packed array @b bits. */
+
+static inline uint32_t wFrozen_getbits (const uint8_t* bits, uint64_t i, unsigned width)
+{
+    uint64_t bit = i * width;
+    uint64_t word;
+    memcpy (&word, bits + (bit >> 3), sizeof (word));
+    return (uint32_t)((word >> (bit & 7)) & (((uint64_t)1 << width) - 1));
+}
+
+/** @brief Returns the symbol of @b edge, an index into @c alpha. */
+
+static inline uint16_t wFrozen_sym (const struct wFrozen* fz, uint32_t edge)
+{
+    return fz -> psyms ? (uint16_t)wFrozen_getbits (fz -> psyms, edge, fz -> symbits) : fz -> syms[edge];
+}
+
+/** @brief Returns the state @b edge leads to. */
+
+static inline uint32_t wFrozen_next (const struct wFrozen* fz, uint32_t edge)
+{
+    return fz -> pnext ? wFrozen_getbits (fz -> pnext, edge, fz -> nextbits) : fz -> next[edge];
+}
+
+/** @brief Packs the model: builds a copy of it which generates in the same way from less memory.
+ *
+ * The weight of keeping each column of the alias tables becomes a fraction of 65536 rounded to nearest,
+ * instead of a fraction of the total weight of its state, and the alias an index from the first edge of
+ * the state, so a column takes 4 bytes instead of 8 and totals are not kept. Columns which always keep
+ * their edge stay exact, and no probability of an edge is off by 2^-16 or more. Symbols of edges take as
+ * many bits as the number of symbols of the model needs instead of 16, and states reached by edges as many
+ * as the number of states needs instead of 32, see wFrozen_sym. Edges stay in the same order.
+ *
+ * @return NULL if fails, pointer to the packed model otherwise. Packing a packed model copies it.
+ */
+
+struct wFrozen* wFrozen_pack (const struct wFrozen* fz)
+{
+    _PRECONDITION_CHEAP (fz, E_WTRIE_NULLPOINTER, return NULL);
+
+    uint64_t nstates  = fz -> nstates;
+    uint64_t nedges   = fz -> nedges;
+    unsigned symbits  = wFrozen_width (fz -> nalpha);
+    unsigned nextbits = wFrozen_width (nstates ? (uint32_t)(nstates - 1) : 0);
+    uint64_t symsz    = wFrozen_packsize (nedges, symbits);
+    uint64_t nextsz   = wFrozen_packsize (nedges, nextbits);
+
+    struct wFrozen* pk = calloc (1, sizeof (struct wFrozen));
+    char* mem = malloc (nedges * sizeof (struct wFrozen_qcol) + (3 * nstates + 1) * sizeof (uint32_t) +
+                        (fz -> nalpha + 1) * sizeof (wchar_t) + symsz + nextsz);
+    if (!pk || !mem)
+    {
+        free (pk);
+        free (mem);
+        errno = E_WFROZEN_NOMEM;
+        return NULL;
+    }
+
+    *pk = *fz;
+    pk -> mem      = mem;
+    pk -> mapsz    = 0;
+    pk -> qcols    = (struct wFrozen_qcol*)mem;
+    pk -> offs     = (uint32_t*)(pk -> qcols + nedges);
+    pk -> back     = pk -> offs + nstates + 1;
+    pk -> order    = pk -> back + nstates;
+    pk -> alpha    = (wchar_t*)(pk -> order + nstates);
+    pk -> psyms    = (uint8_t*)(pk -> alpha + fz -> nalpha + 1);
+    pk -> pnext    = pk -> psyms + symsz;
+    pk -> symbits  = symbits;
+    pk -> nextbits = nextbits;
+    pk -> syms     = NULL;
+    pk -> next     = NULL;
+    pk -> cols     = NULL;
+    pk -> total    = NULL;
+
+    memcpy (pk -> offs,  fz -> offs,  (nstates + 1) * sizeof (uint32_t));
+    memcpy (pk -> back,  fz -> back,  nstates * sizeof (uint32_t));
+    memcpy (pk -> order, fz -> order, nstates * sizeof (uint32_t));
+    memcpy (pk -> alpha, fz -> alpha, (fz -> nalpha + 1) * sizeof (wchar_t));
+    memset (pk -> psyms, 0, symsz + nextsz);
+    if (fz -> qcols) memcpy (pk -> qcols, fz -> qcols, nedges * sizeof (struct wFrozen_qcol));
+
+    for (uint32_t s = 0; s < nstates; s++)
+    {
+        uint32_t base = fz -> offs[s];
+        for (uint32_t e = base; !fz -> qcols && e < fz -> offs[s + 1]; e++)
+        {
+            uint64_t q = (((uint64_t)fz -> cols[e].prob << 16) + fz -> total[s] / 2) / fz -> total[s];
+            // A column keeping its edge always cannot say so in 16 bits, so it becomes its own alias
+            pk -> qcols[e].prob  = q > UINT16_MAX ? UINT16_MAX : (uint16_t)q;
+            pk -> qcols[e].alias = (uint16_t)((q > UINT16_MAX ? e : fz -> cols[e].alias) - base);
+        }
+        for (uint32_t e = base; e < fz -> offs[s + 1]; e++)
+        {
+            wFrozen_setbits (pk -> psyms, e, symbits, wFrozen_sym (fz, e));
+            wFrozen_setbits (pk -> pnext, e, nextbits, wFrozen_next (fz, e));
+        }
+    }
+    return pk;
+}
+
+/** @brief Frees the frozen model and all of its arrays, or unmaps its file. */
+
+void wFrozen_free (struct wFrozen* fz)
+{
+    if (!fz) return;
+    if (fz -> mapsz) munmap (fz -> mem, fz -> mapsz);
+    else             free (fz -> mem);
+    free (fz);
+}
+
+/** @brief Service function rounding a file offset up to WFROZEN_ALIGN. */
+
+uint64_t wFrozen_align (uint64_t offset)
+{
+    return (offset + WFROZEN_ALIGN - 1) & ~(uint64_t)(WFROZEN_ALIGN - 1);
+}
+
+/** @brief Service function writing an array to the model file at given offset, padding up to it. */
+
+int wFrozen_write (FILE* outfile, uint64_t* pos, uint64_t offset, const void* data, size_t size)
+{
+    static const char zeros[WFROZEN_ALIGN] = { 0 };
+    if (offset - *pos > 0 && fwrite (zeros, 1, offset - *pos, outfile) != offset - *pos) return 0;
+    if (size && fwrite (data, 1, size, outfile) != size) return 0;
+    *pos = offset + size;
+    return 1;
+}
+
+/** @brief Service function putting the sizes in bytes of the arrays of edges of the model, which depend on
+ * whether it is packed, into @b next, @b syms, @b total and @b cols.
+ */
+
+void wFrozen_sizes (const struct wFrozen* fz, uint64_t* next, uint64_t* syms, uint64_t* total, uint64_t* cols)
+{
+    bool packed = fz -> qcols != NULL;
+    *next  = packed ? wFrozen_packsize (fz -> nedges, fz -> nextbits) : (uint64_t)fz -> nedges * sizeof (uint32_t);
+    *syms  = packed ? wFrozen_packsize (fz -> nedges, fz -> symbits) : (uint64_t)fz -> nedges * sizeof (uint16_t);
+    *total = packed ? 0 : (uint64_t)fz -> nstates * sizeof (uint32_t);
+    *cols  = (uint64_t)fz -> nedges * (packed ? sizeof (struct wFrozen_qcol) : sizeof (struct wFrozen_col));
+}
+
+/** @brief Saves the frozen model to a binary file, see wFrozen_header.
+ *
+ * The model is written to @b out_fname ".tmp" first, then renamed over @b out_fname, so processes which
+ * have the old file mapped go on generating from it.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wFrozen_save (const struct wFrozen* fz, const char* out_fname)
+{
+    _PRECONDITION_CHEAP ((fz && out_fname), E_WTRIE_NULLPOINTER, return 0);
+
+    struct wFrozen_header hdr;
+    memset (&hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, WFROZEN_MAGIC, sizeof (hdr.magic));
+    hdr.version   = fz -> qcols ? WFROZEN_PACKED : WFROZEN_VERSION;
+    hdr.byteorder = 0x01020304;
+    hdr.wcsize    = sizeof (wchar_t);
+    hdr.context   = fz -> context;
+    hdr.nstates   = fz -> nstates;
+    hdr.nedges    = fz -> nedges;
+    hdr.start     = fz -> start;
+    hdr.nalpha    = fz -> nalpha;
+    uint64_t nextsz, symsz, totalsz, colsz;
+    wFrozen_sizes (fz, &nextsz, &symsz, &totalsz, &colsz);
+    hdr.offs      = wFrozen_align (sizeof (hdr));
+    hdr.next      = wFrozen_align (hdr.offs + ((uint64_t)fz -> nstates + 1) * sizeof (uint32_t));
+    hdr.syms      = wFrozen_align (hdr.next + nextsz);
+    hdr.alpha     = wFrozen_align (hdr.syms + symsz);
+    hdr.total     = wFrozen_align (hdr.alpha + ((uint64_t)fz -> nalpha + 1) * sizeof (wchar_t));
+    hdr.back      = wFrozen_align (hdr.total + totalsz);
+    hdr.order     = wFrozen_align (hdr.back + (uint64_t)fz -> nstates * sizeof (uint32_t));
+    hdr.cols      = wFrozen_align (hdr.order + (uint64_t)fz -> nstates * sizeof (uint32_t));
+    hdr.size      = hdr.cols + colsz;
+
+    const void* next = fz -> qcols ? (const void*)fz -> pnext : (const void*)fz -> next;
+    const void* syms = fz -> qcols ? (const void*)fz -> psyms : (const void*)fz -> syms;
+    const void* cols = fz -> qcols ? (const void*)fz -> qcols : (const void*)fz -> cols;
+
+    // Processes may be generating from a mapping of the old file, which is replaced rather than truncated
+    size_t namesz = strlen (out_fname) + 5;
+    char* tmp_fname = malloc (namesz);
+    _PRECONDITION (tmp_fname, E_WFROZEN_IO, return 0);
+    snprintf (tmp_fname, namesz, "%s.tmp", out_fname);
+
+    FILE* outfile = fopen (tmp_fname, "wb");
+    if (!outfile) free (tmp_fname);
+    _PRECONDITION (outfile, E_WFROZEN_IO, return 0);
+
+    uint64_t pos = 0;
+    int ok = wFrozen_write (outfile, &pos, 0,        &hdr,       sizeof (hdr)) &&
+             wFrozen_write (outfile, &pos, hdr.offs, fz -> offs, ((size_t)fz -> nstates + 1) * sizeof (uint32_t)) &&
+             wFrozen_write (outfile, &pos, hdr.next, next, nextsz) &&
+             wFrozen_write (outfile, &pos, hdr.syms, syms, symsz) &&
+             wFrozen_write (outfile, &pos, hdr.alpha, fz -> alpha, ((size_t)fz -> nalpha + 1) * sizeof (wchar_t)) &&
+             wFrozen_write (outfile, &pos, hdr.total, fz -> total, totalsz) &&
+             wFrozen_write (outfile, &pos, hdr.back,  fz -> back,  (size_t)fz -> nstates * sizeof (uint32_t)) &&
+             wFrozen_write (outfile, &pos, hdr.order, fz -> order, (size_t)fz -> nstates * sizeof (uint32_t)) &&
+             wFrozen_write (outfile, &pos, hdr.cols,  cols, colsz);
+    if (fclose (outfile) != 0) ok = 0;
+    ok = ok && rename (tmp_fname, out_fname) == 0;
+    if (!ok) unlink (tmp_fname);
+    free (tmp_fname);
+    _PRECONDITION (ok, E_WFROZEN_IO, return 0);
+
+    return 1;
+}
+
+/** @brief Service function checking that an array of @b n items of @b size bytes at offset @b off lies
+ * within @b filesize bytes of a file, without overflowing on any of them.
+ */
+
+bool wFrozen_fits (uint64_t off, uint64_t n, uint64_t size, uint64_t filesize)
+{
+    return off <= filesize && n <= (filesize - off) / size;
+}
+
+/** @brief Service function checking that the arrays of a loaded model are consistent, so that generating
+ * from it reads nothing out of them and always ends backing off, in one pass over states and edges.
+ *
+ * Offsets of edges must not decrease and every state must have edges. Symbols must be in the alphabet,
+ * edges of symbols must lead to states, aliases to edges of their own state. Every state but those of
+ * the empty context must back off to a state of a shorter context, so backing off always ends.
+ *
+ * @return 0 if the model is not consistent, 1 otherwise.
+ */
+
+int wFrozen_check (const struct wFrozen* fz)
+{
+    if (!fz -> nstates) return 1;
+    if (fz -> offs[0] != 0 || fz -> offs[fz -> nstates] != fz -> nedges || fz -> start >= fz -> nstates)
+        return 0;
+
+    for (uint32_t s = 0; s < fz -> nstates; s++)
+    {
+        uint32_t base = fz -> offs[s];
+        uint32_t end  = fz -> offs[s + 1];
+        uint32_t back = fz -> back[s];
+        if (end <= base || end > fz -> nedges || fz -> order[s] > fz -> context) return 0;
+        if (!fz -> qcols && !fz -> total[s]) return 0;
+        if (back == WFROZEN_NONE ? fz -> order[s] != 0
+                                 : back >= fz -> nstates || fz -> order[back] >= fz -> order[s]) return 0;
+
+        for (uint32_t e = base; e < end; e++)
+        {
+            uint16_t sym = wFrozen_sym (fz, e);
+            if (sym > fz -> nalpha || (sym && wFrozen_next (fz, e) >= fz -> nstates)) return 0;
+            if (fz -> qcols ? fz -> qcols[e].alias >= end - base
+                            : fz -> cols[e].alias < base || fz -> cols[e].alias >= end) return 0;
+        }
+    }
+    return 1;
+}
+
+/** @brief Maps a model file saved with wFrozen_save into memory.
+ *
+ * The file is mapped read-only and shared, the returned model points right into the mapping and must
+ * not be changed. Checks the header, that all of the arrays lie within the file and that they are
+ * consistent, see wFrozen_check, which reads the whole file once.
+ *
+ * @return NULL if fails, pointer to the loaded model otherwise.
+ */
+
+struct wFrozen* wFrozen_load (const char* in_fname)
+{
+    _PRECONDITION_CHEAP (in_fname, E_WTRIE_NULLPOINTER, return NULL);
+
+    int fd = open (in_fname, O_RDONLY);
+    _PRECONDITION ((fd >= 0), E_WFROZEN_IO, return NULL);
+
+    struct stat st;
+    if (fstat (fd, &st) != 0 || (uint64_t)st.st_size < sizeof (struct wFrozen_header))
+    {
+        close (fd);
+        errno = E_WFROZEN_BADFILE;
+        return NULL;
+    }
+
+    size_t mapsz = (size_t)st.st_size;
+    void* mem = mmap (NULL, mapsz, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    _PRECONDITION ((mem != MAP_FAILED), E_WFROZEN_IO, return NULL);
+
+    const struct wFrozen_header* hdr = mem;
+    uint64_t nstates = hdr -> nstates;
+    uint64_t nedges = hdr -> nedges;
+    int ok = memcmp (hdr -> magic, WFROZEN_MAGIC, sizeof (hdr -> magic)) == 0;
+    // Counts go into 32 bits and bound the sizes of the arrays below, so none of them overflows
+    ok = ok && nstates < WFROZEN_NONE && nedges <= UINT32_MAX && hdr -> nalpha <= UINT16_MAX &&
+               (hdr -> start < nstates || !nstates);
+    if (ok && hdr -> version != WFROZEN_VERSION && hdr -> version != WFROZEN_PACKED)
+    {
+        munmap (mem, mapsz);
+        errno = E_WFROZEN_VERSION;
+        return NULL;
+    }
+    // Sizes of the arrays of edges are those of a model of the counts in the header, packed or not
+    struct wFrozen shape;
+    struct wFrozen_qcol none;
+    memset (&shape, 0, sizeof (shape));
+    shape.nstates  = hdr -> nstates;
+    shape.nedges   = nedges;
+    shape.qcols    = hdr -> version == WFROZEN_PACKED ? &none : NULL;
+    shape.symbits  = wFrozen_width (hdr -> nalpha);
+    shape.nextbits = wFrozen_width (nstates ? (uint32_t)(nstates - 1) : 0);
+    uint64_t nextsz, symsz, totalsz, colsz;
+    wFrozen_sizes (&shape, &nextsz, &symsz, &totalsz, &colsz);
+
+    ok = ok && hdr -> byteorder == 0x01020304 &&
+               hdr -> wcsize    == sizeof (wchar_t) &&
+               hdr -> size      <= mapsz &&
+               hdr -> offs  % WFROZEN_ALIGN == 0 && hdr -> next % WFROZEN_ALIGN == 0 &&
+               hdr -> syms  % WFROZEN_ALIGN == 0 && hdr -> total % WFROZEN_ALIGN == 0 &&
+               hdr -> cols  % WFROZEN_ALIGN == 0 && hdr -> back  % WFROZEN_ALIGN == 0 &&
+               hdr -> order % WFROZEN_ALIGN == 0 && hdr -> alpha % WFROZEN_ALIGN == 0 &&
+               wFrozen_fits (hdr -> offs,  nstates + 1,      sizeof (uint32_t), hdr -> size) &&
+               wFrozen_fits (hdr -> next,  nextsz,           1,                 hdr -> size) &&
+               wFrozen_fits (hdr -> syms,  symsz,            1,                 hdr -> size) &&
+               wFrozen_fits (hdr -> alpha, hdr -> nalpha + 1, sizeof (wchar_t), hdr -> size) &&
+               wFrozen_fits (hdr -> total, totalsz,          1,                 hdr -> size) &&
+               wFrozen_fits (hdr -> back,  nstates,          sizeof (uint32_t), hdr -> size) &&
+               wFrozen_fits (hdr -> order, nstates,          sizeof (uint32_t), hdr -> size) &&
+               wFrozen_fits (hdr -> cols,  colsz,            1,                 hdr -> size);
+
+    struct wFrozen* fz = ok ? calloc (1, sizeof (struct wFrozen)) : NULL;
+    if (!fz)
+    {
+        munmap (mem, mapsz);
+        errno = ok ? E_WFROZEN_NOMEM : E_WFROZEN_BADFILE;
+        return NULL;
+    }
+
+    fz -> context  = hdr -> context;
+    fz -> maxorder = hdr -> context;
+    fz -> nstates  = hdr -> nstates;
+    fz -> nedges   = hdr -> nedges;
+    fz -> start    = hdr -> start;
+    fz -> offs     = (uint32_t*)((char*)mem + hdr -> offs);
+    fz -> next     = (uint32_t*)((char*)mem + hdr -> next);
+    fz -> nalpha   = hdr -> nalpha;
+    fz -> syms     = (uint16_t*)((char*)mem + hdr -> syms);
+    fz -> alpha    = (wchar_t*)((char*)mem + hdr -> alpha);
+    fz -> total    = (uint32_t*)((char*)mem + hdr -> total);
+    fz -> back     = (uint32_t*)((char*)mem + hdr -> back);
+    fz -> order    = (uint32_t*)((char*)mem + hdr -> order);
+    fz -> cols     = (struct wFrozen_col*)((char*)mem + hdr -> cols);
+    fz -> mem      = mem;
+    fz -> mapsz    = mapsz;
+    if (shape.qcols)
+    {
+        fz -> qcols    = (struct wFrozen_qcol*)fz -> cols;
+        fz -> psyms    = (uint8_t*)fz -> syms;
+        fz -> pnext    = (uint8_t*)fz -> next;
+        fz -> symbits  = shape.symbits;
+        fz -> nextbits = shape.nextbits;
+        fz -> cols     = NULL;
+        fz -> syms     = NULL;
+        fz -> next     = NULL;
+        fz -> total    = NULL;
+    }
+
+    if (!wFrozen_check (fz))
+    {
+        wFrozen_free (fz);
+        errno = E_WFROZEN_BADFILE;
+        return NULL;
+    }
+    return fz;
+}
+
+/** @brief Picks an edge of the state by a number @b rnd drawn uniformly from all 64-bit numbers.
+ *
+ * The high part of @b rnd times the number of edges selects a column of the alias table, the fraction
+ * left over is scaled to the total weight of the state to decide between the column and its alias. Both
+ * are multiplications, no division or search is involved. States with a single edge, the most of them in
+ * models with long contexts, read nothing but their offsets.
+ *
+ * @return Index of the picked edge.
+ */
+
+static inline uint32_t wFrozen_pick (const struct wFrozen* fz, uint32_t state, uint64_t rnd)
+{
+    uint32_t base = fz -> offs[state];
+    uint32_t k    = fz -> offs[state + 1] - base;
+    if (k == 1) return base;
+
+    unsigned __int128 col = (unsigned __int128)rnd * k;
+    uint32_t edge = base + (uint32_t)(col >> 64);
+    if (fz -> qcols)
+    {
+        struct wFrozen_qcol q = fz -> qcols[edge];
+        return ((uint64_t)col >> 48) < q.prob ? edge : base + q.alias;
+    }
+    uint64_t keep = (uint64_t)(((unsigned __int128)(uint64_t)col * fz -> total[state]) >> 64);
+    struct wFrozen_col c = fz -> cols[edge];
+    return keep < c.prob ? edge : c.alias;
+}
+
+/** @brief Service function following @b edge picked at state @b s: moves @c *state to the state the edge
+ * leads to, the start state at the end of a document.
+ *
+ * @return Symbol of the edge.
+ */
+
+static inline uint16_t wFrozen_follow (const struct wFrozen* fz, uint32_t* state, uint32_t s, uint32_t edge)
+{
+    (void)s;    // Only counted with WSTATS
+    uint16_t sym = wFrozen_sym (fz, edge);
+    WSTATS_ADD (gen_steps, 1);
+    if (sym)
+    {
+        *state = wFrozen_next (fz, edge);
+        WSTATS_ADD (gen_backoffs, fz -> order[*state] <= fz -> order[s] && fz -> order[*state] < fz -> context);
+    }
+    else
+    {
+        WSTATS_ADD (gen_ends, 1);
+        *state = fz -> start;
+    }
+    return sym;
+}
+
+/** @brief Returns whether the model is of documents: its edges of symbol 0 end documents and go back to
+ * the start state, writing @c alpha[0], a newline, in between. @c alpha[0] is 0 for models of a
+ * continuous text, which have no such edges.
+ */
+
+static inline bool wFrozen_docs (const struct wFrozen* fz)
+{
+    return fz -> alpha[0] != L'\0';
+}
+
+/** @brief Takes a step of generation from @c *state, limited to contexts of @b maxorder symbols at most,
+ * and moves @c *state to the state it leads to: the start state at the end of a document.
+ *
+ * @return Symbol of the step, an index into @c alpha.
+ */
+
+static inline uint16_t wFrozen_step (const struct wFrozen* fz, uint32_t* state, unsigned maxorder,
+                                     struct wRandom* rng)
+{
+    uint32_t s = *state;
+    if (maxorder < fz -> context)
+        while (fz -> order[s] > maxorder) s = fz -> back[s];
+    return wFrozen_follow (fz, state, s, wFrozen_pick (fz, s, wRandom_next (rng)));
+}
+
+/** @brief Writes @b length symbols generated by the model with @b rng to @b out.
+ *
+ * The walk starts from the start state. Before every step it backs off to the longest context no longer
+ * than @c maxorder, if that is limited. A model of documents goes on past @b length to the end of the
+ * current document, writing twice @b length symbols at most, so the output is made of whole lines. Stops
+ * early if a write fails.
+ */
+
+void wFrozen_walk (const struct wFrozen* fz, struct wRandom* rng, size_t length, struct wOutbuf* out)
+{
+    _PRECONDITION_CHEAP ((fz && rng && out), E_WTRIE_NULLPOINTER, return);
+
+    uint32_t state = fz -> start;
+    size_t limit = (wFrozen_docs (fz) && length <= SIZE_MAX / 2) ? 2 * length : length;
+    for (size_t i = 0; i < limit && fz -> nstates && !out -> failed; i++)
+    {
+        uint16_t sym = wFrozen_step (fz, &state, fz -> maxorder, rng);
+        wOutbuf_put (out, fz -> alpha[sym]);
+        if (!sym && i + 1 >= length) break;
+    }
+}
+
+#define WFROZEN_GROUP    8          //!< Most documents a thread of wFrozen_batch generates at once.
+#define WFROZEN_GROUPMEM (1 << 24)  //!< Most bytes of framed documents a thread keeps in memory at once.
+
+/** @brief Document generated by wFrozen_walkgroup, along with others. */
+
+struct wFrozen_stream
+{
+    struct wRandom rng;     //!< Random generator of the document.
+    struct wOutbuf out;     //!< Output of the document.
+    uint32_t       state;   //!< State the next step is taken from, after backing off to @c maxorder.
+    uint32_t       base;    //!< First edge of the state.
+    uint32_t       edge;    //!< Column of the alias table drawn for the step.
+    uint64_t       keep;    //!< Weight drawn to decide between the column and its alias.
+    bool           single;  //!< Whether the state has a single edge, so the edge is the column.
+    size_t         i;       //!< Number of symbols written.
+    bool           done;    //!< Whether the document is done.
+};
+
+/** @brief Same as wFrozen_walk for each of @b n documents at once, writing the same output for each.
+ *
+ * A step of a walk reads the offsets and total of its state, then the column of the alias table it draws,
+ * each likely a cache miss into a large model, and each depending on the one before. Steps of independent
+ * documents are taken in rounds instead: the columns of all of them are drawn first, prefetching each,
+ * then they are resolved, prefetching the next states, so every document waits on memory while the
+ * others are worked on rather than one after the other.
+ */
+
+void wFrozen_walkgroup (const struct wFrozen* fz, struct wFrozen_stream* st, unsigned n, size_t length)
+{
+    _PRECONDITION_CHEAP ((fz && (st || !n)), E_WTRIE_NULLPOINTER, return);
+
+    unsigned maxorder = fz -> maxorder;
+    bool limited = maxorder < fz -> context;
+    size_t limit = (wFrozen_docs (fz) && length <= SIZE_MAX / 2) ? 2 * length : length;
+    unsigned live = 0;
+    for (unsigned j = 0; j < n; j++)
+    {
+        st[j].state = fz -> start;
+        st[j].i     = 0;
+        st[j].done  = !fz -> nstates || !limit || st[j].out.failed;
+        live += !st[j].done;
+    }
+
+    while (live)
+    {
+        for (unsigned j = 0; j < n; j++)
+        {
+            if (st[j].done) continue;
+            uint32_t s = st[j].state;
+            if (limited)
+                while (fz -> order[s] > maxorder) s = fz -> back[s];
+            st[j].state = s;
+
+            uint32_t base = fz -> offs[s];
+            uint32_t k    = fz -> offs[s + 1] - base;
+            uint64_t rnd  = wRandom_next (&st[j].rng);
+            st[j].single = k == 1;
+            st[j].base   = base;
+            st[j].edge   = base;
+            if (k == 1) continue;
+
+            unsigned __int128 col = (unsigned __int128)rnd * k;
+            st[j].edge = base + (uint32_t)(col >> 64);
+            if (fz -> qcols)
+            {
+                st[j].keep = (uint64_t)col >> 48;
+                __builtin_prefetch (fz -> qcols + st[j].edge);
+                continue;
+            }
+            st[j].keep = (uint64_t)(((unsigned __int128)(uint64_t)col * fz -> total[s]) >> 64);
+            __builtin_prefetch (fz -> cols + st[j].edge);
+        }
+
+        for (unsigned j = 0; j < n; j++)
+        {
+            if (st[j].done) continue;
+            uint32_t edge = st[j].edge;
+            if (!st[j].single && fz -> qcols)
+            {
+                struct wFrozen_qcol q = fz -> qcols[edge];
+                edge = st[j].keep < q.prob ? edge : st[j].base + q.alias;
+            }
+            else if (!st[j].single)
+            {
+                struct wFrozen_col c = fz -> cols[edge];
+                edge = st[j].keep < c.prob ? edge : c.alias;
+            }
+            uint16_t sym = wFrozen_follow (fz, &st[j].state, st[j].state, edge);
+            wOutbuf_put (&st[j].out, fz -> alpha[sym]);
+
+            st[j].i++;
+            st[j].done = st[j].i >= limit || st[j].out.failed || (!sym && st[j].i >= length);
+            if (st[j].done)
+            {
+                live--;
+                continue;
+            }
+            __builtin_prefetch (fz -> offs + st[j].state);
+            if (!fz -> qcols) __builtin_prefetch (fz -> total + st[j].state);
+            if (limited) __builtin_prefetch (fz -> order + st[j].state);
+        }
+    }
+}
+
+#define WFROZEN_FRAME "#markflow %zu %zu\n"   //!< Header of every document in a framed stream: index, size.
+
+/** @brief Job of generating a batch of documents on a pool of threads, see wFrozen_batch. */
+
+struct wFrozen_batch
+{
+    const struct wFrozen* fz;       //!< The model.
+    uint64_t        seed;           //!< Seed of the batch.
+    size_t          ndocs;          //!< Number of documents.
+    size_t          length;         //!< Number of symbols of each document.
+    const char*     prefix;         //!< Documents go to files named prefix, index, ".txt" if not NULL.
+    int             fd;             //!< Framed stream of documents otherwise.
+    size_t          next;           //!< Index of the next document to generate.
+    size_t          written;        //!< Number of documents written to the stream.
+    int             failed;         //!< Whether any document failed.
+    pthread_mutex_t lock;           //!< Guards everything from @c next on.
+    pthread_cond_t  turn;           //!< Signalled when a document has been written to the stream.
+};
+
+/** @brief Service function opening the file of document @b idx of the batch.
+ *
+ * @return Descriptor of the file, -1 if fails.
+ */
+
+int wFrozen_batchopen (struct wFrozen_batch* job, size_t idx)
+{
+    size_t namesz = strlen (job -> prefix) + 32;
+    char* name = malloc (namesz);
+    if (!name) return -1;
+    snprintf (name, namesz, "%s%zu.txt", job -> prefix, idx);
+    int fd = open (name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    free (name);
+    return fd;
+}
+
+/** @brief Service function writing document @b idx of the batch, generated into @b out, to the stream in
+ * order of indices, after all documents before it. Marks the batch failed instead if @b ok is 0 or the
+ * document did not fit in @b out.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wFrozen_batchwrite (struct wFrozen_batch* job, size_t idx, const struct wOutbuf* out, int ok)
+{
+    const unsigned char* mem = out -> buf;
+    size_t len = out -> len;
+    char header[64];
+    int hlen = snprintf (header, sizeof (header), WFROZEN_FRAME, idx, len);
+    ok = ok && !out -> full && !out -> failed;
+
+    pthread_mutex_lock (&job -> lock);
+    while (job -> written != idx && !job -> failed) pthread_cond_wait (&job -> turn, &job -> lock);
+    ok = ok && !job -> failed;
+    pthread_mutex_unlock (&job -> lock);
+
+    ok = ok && wwriteall (job -> fd, header, hlen) && wwriteall (job -> fd, mem, len);
+
+    pthread_mutex_lock (&job -> lock);
+    job -> written++;
+    if (!ok) job -> failed = 1;
+    pthread_cond_broadcast (&job -> turn);
+    pthread_mutex_unlock (&job -> lock);
+    return ok;
+}
+
+/** @brief Service function of worker threads, taking documents of the batch a group at a time.
+ *
+ * A group is WFROZEN_GROUP consecutive documents, generated at once with wFrozen_walkgroup, or fewer
+ * framed ones if they would take more than WFROZEN_GROUPMEM bytes of memory. Framed documents of a group
+ * are then written in order of their indices, as they follow each other.
+ */
+
+void* wFrozen_batchrun (void* arg)
+{
+    struct wFrozen_batch* job = arg;
+    // Walks of a model of documents go on to the end of the current one, up to twice the length
+    size_t limit = wFrozen_docs (job -> fz) ? 2 * job -> length : job -> length;
+    size_t docsz = 4 * limit + 1;
+    size_t fit = WFROZEN_GROUPMEM / docsz;
+    unsigned group = (job -> prefix || fit >= WFROZEN_GROUP) ? WFROZEN_GROUP : fit ? (unsigned)fit : 1;
+    unsigned char* mem = job -> prefix ? NULL : malloc (group * docsz);
+    int ok = job -> prefix || mem;
+
+    struct wFrozen_stream st[WFROZEN_GROUP];
+    int fds[WFROZEN_GROUP];
+    for (;;)
+    {
+        pthread_mutex_lock (&job -> lock);
+        size_t idx = job -> next;
+        size_t got = idx < job -> ndocs ? job -> ndocs - idx : 0;
+        if (got > group) got = group;
+        job -> next += got;
+        if (!ok) job -> failed = 1;
+        int stop = job -> failed || !got;
+        if (stop) pthread_cond_broadcast (&job -> turn);
+        pthread_mutex_unlock (&job -> lock);
+        if (stop) break;
+
+        for (size_t j = 0; j < got; j++)
+        {
+            wRandom_stream (&st[j].rng, job -> seed, idx + j);
+            fds[j] = job -> prefix ? wFrozen_batchopen (job, idx + j) : -1;
+            if (!job -> prefix)
+                wOutbuf_mem (&st[j].out, mem + j * docsz, 4 * limit);
+            else if (fds[j] < 0 || !wOutbuf_fd (&st[j].out, fds[j], 0))
+            {
+                wOutbuf_mem (&st[j].out, NULL, 0);
+                st[j].out.failed = 1;
+            }
+        }
+
+        wFrozen_walkgroup (job -> fz, st, (unsigned)got, job -> length);
+
+        for (size_t j = 0; j < got; j++)
+        {
+            if (!job -> prefix)
+            {
+                ok = wFrozen_batchwrite (job, idx + j, &st[j].out, ok) && ok;
+                continue;
+            }
+            ok = wOutbuf_close (&st[j].out) && ok;
+            if (fds[j] >= 0) ok = (close (fds[j]) == 0) && ok;
+        }
+    }
+
+    free (mem);
+    WSTATS_FLUSH ();
+    return NULL;
+}
+
+/** @brief Generates @b ndocs documents of @b length symbols each from the model on @b nthreads threads.
+ *
+ * Threads share the model and take documents a few at a time, interleaving their steps (see
+ * wFrozen_walkgroup), so they keep busy until the batch is done. Document @c i is generated with sequence
+ * @c i of @b seed (see wRandom_stream), so every document is the same whatever the number of threads. If
+ * @b prefix is not NULL, document @c i goes to file @b prefix @c i ".txt". Otherwise documents go to
+ * descriptor @b fd in order of indices, each preceded by a line WFROZEN_FRAME giving its index and size in
+ * bytes; each thread then keeps its documents in memory until they are written.
+ *
+ * @return 0 if fails to generate or write any document, 1 otherwise.
+ */
+
+int wFrozen_batch (const struct wFrozen* fz, uint64_t seed, size_t ndocs, size_t length,
+                   const char* prefix, int fd, unsigned nthreads)
+{
+    _PRECONDITION_CHEAP (fz,                     E_WTRIE_NULLPOINTER, return 0);
+    _PRECONDITION_CHEAP ((prefix || fd >= 0),    E_WFROZEN_IO,        return 0);
+    _PRECONDITION       ((length < SIZE_MAX / 8), E_WFROZEN_TOOBIG,   return 0);
+
+    struct wFrozen_batch job;
+    memset (&job, 0, sizeof (job));
+    job.fz     = fz;
+    job.seed   = seed;
+    job.ndocs  = ndocs;
+    job.length = length;
+    job.prefix = prefix;
+    job.fd     = fd;
+    pthread_mutex_init (&job.lock, NULL);
+    pthread_cond_init (&job.turn, NULL);
+
+    if (nthreads > ndocs) nthreads = ndocs ? ndocs : 1;
+    pthread_t* threads = calloc (nthreads, sizeof (pthread_t));
+    unsigned started = 0;
+    while (threads && started + 1 < nthreads && pthread_create (&threads[started], NULL, wFrozen_batchrun, &job) == 0)
+        started++;
+    wFrozen_batchrun (&job);
+    for (unsigned i = 0; i < started; i++) pthread_join (threads[i], NULL);
+    free (threads);
+
+    pthread_mutex_destroy (&job.lock);
+    pthread_cond_destroy (&job.turn);
+    _PRECONDITION (!job.failed, E_WFROZEN_IO, return 0);
+    return 1;
+}
+
+#endif
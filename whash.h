@@ -0,0 +1,675 @@
+/**
+ * @file whash.h
+ * @brief Training backend counting windows of the text in a hash table
+ *
+ * The trie backend (see wMarkov_trainer) walks the trie for every position of the text, which touches
+ * nodes scattered over memory and spawns every node as soon as it is met. A wHash counts windows of
+ * @c context + 1 symbols, a context and the symbol following it, in an open addressing table instead:
+ * keys are packed in a flat array, @c context + 1 symbols per slot next to flat counts, and the rolling
+ * hash of the window is updated in O(1) per position, so a position costs one probe on average and a
+ * comparison of keys.
+ *
+ * Once the text is counted, the table is turned into the trie of the trainer with wHash_apply, at a cost
+ * of a walk per distinct window rather than per position. The trainer is left exactly as the trie
+ * backend would leave it, counts and the state of the window included, so everything downstream of
+ * training works on it unchanged, see wHash_backend. The table only needs memory for distinct windows,
+ * but each of them holds its whole key, so it pays off on texts which repeat their windows often.
+ *
+ * The memory of the table may be capped, see wMarkov_trainer. Once it would grow past the cap, the table
+ * is sorted and spilled to disk as a run of windows with their counts, and starts over empty. wHash_apply
+ * then merges the runs, adding up counts of the same windows, into the same sorted sequence of distinct
+ * windows it would have got from a table holding them all, so the trie is exactly the same. The cap only
+ * bounds the table: the whole trie is still built in memory, and frozen along with it.
+ */
+
+#ifndef _WHASH_H_
+#define _WHASH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "wtrie.h"
+#include "wmarkov.h"
+
+#define WHASH_MULT  0x9E3779B97F4A7C15ull   //!< Base of the rolling hash, odd.
+#define WHASH_SLOTS 1024                    //!< Initial number of slots.
+#define WHASH_HIST  (1 << 12)               //!< Minimal number of symbols kept in the history buffer.
+
+/** @brief Table of counts of windows, with the window sliding over the text fed so far.
+ *
+ * Holds the last symbols fed in a history buffer. Windows are counted WMARKOV_LAG symbols behind the last
+ * symbol fed, like the trainer does, so the text may end at any symbol.
+ */
+
+struct wHash
+{
+    unsigned       context; //!< Length of contexts.
+    unsigned       width;   //!< Length of keys, @c context + 1.
+    uint64_t       mask;    //!< Number of slots minus one, the number of slots is a power of 2.
+    uint64_t       nkeys;   //!< Number of distinct windows.
+    unsigned long* counts;  //!< Count of the window of each slot, 0 for empty slots.
+    wchar_t*       keys;    //!< Windows of slots, @c width symbols each.
+    wchar_t*       hist;    //!< The last symbols fed.
+    size_t         nhist;   //!< Number of symbols in @c hist.
+    size_t         caphist; //!< Capacity of @c hist.
+    uint64_t       seen;    //!< Number of symbols fed in all.
+    uint64_t       roll;    //!< Rolling hash of the window ending WMARKOV_LAG symbols before the last one.
+    uint64_t       pow;     //!< WHASH_MULT to the power of @c width.
+    size_t         npos;    //!< Number of windows counted.
+    wchar_t*       first;   //!< First context of the text, @c context symbols, if it has been fed.
+    bool           hasfirst; //!< Whether @c first is set.
+    const struct wAlpha* lines; //!< Alphabet of the text if lines are counted as documents, NULL otherwise.
+    bool           midline; //!< Whether the current line of such a text has symbols.
+    size_t         budget;  //!< Bytes the slots may take, growing them included, 0 for no limit.
+    FILE**         runs;    //!< Runs spilled to disk, see wHash_spill.
+    unsigned       nruns;   //!< Number of runs.
+};
+
+/** @brief Service function hashing the window of @b width symbols at @b key, as rolled by wHash_push. */
+
+uint64_t wHash_of (const wchar_t* key, unsigned width)
+{
+    uint64_t roll = 0;
+    for (unsigned j = 0; j < width; j++) roll = roll * WHASH_MULT + (uint32_t)key[j];
+    return roll;
+}
+
+/** @brief Service function mixing a rolling hash into a slot of the table. */
+
+static inline uint64_t wHash_slot (const struct wHash* hs, uint64_t roll)
+{
+    roll ^= roll >> 33;
+    roll *= 0xFF51AFD7ED558CCDull;
+    roll ^= roll >> 33;
+    return roll & hs -> mask;
+}
+
+/** @brief Frees the memory of the table. */
+
+void wHash_free (struct wHash* hs)
+{
+    if (!hs) return;
+    free (hs -> counts);
+    free (hs -> keys);
+    free (hs -> hist);
+    free (hs -> first);
+    for (unsigned i = 0; i < hs -> nruns; i++) fclose (hs -> runs[i]);
+    free (hs -> runs);
+    memset (hs, 0, sizeof (struct wHash));
+}
+
+/** @brief Service function doubling the number of slots, rehashing keys.
+ *
+ * @return 0 if fails, the table is left as it was then, 1 otherwise.
+ */
+
+int wHash_grow (struct wHash* hs)
+{
+    uint64_t size = 2 * (hs -> mask + 1);
+    unsigned long* counts = calloc (size, sizeof (unsigned long));
+    wchar_t*       keys   = malloc (size * hs -> width * sizeof (wchar_t));
+    if (!counts || !keys)
+    {
+        free (counts);
+        free (keys);
+        return 0;
+    }
+
+    struct wHash grown = *hs;
+    grown.mask   = size - 1;
+    grown.counts = counts;
+    grown.keys   = keys;
+    for (uint64_t i = 0; i <= hs -> mask; i++)
+    {
+        if (!hs -> counts[i]) continue;
+
+        const wchar_t* key = hs -> keys + i * hs -> width;
+        uint64_t slot = wHash_slot (&grown, wHash_of (key, hs -> width));
+        while (counts[slot]) slot = (slot + 1) & grown.mask;
+        counts[slot] = hs -> counts[i];
+        wmemcpy (keys + slot * hs -> width, key, hs -> width);
+    }
+
+    free (hs -> counts);
+    free (hs -> keys);
+    *hs = grown;
+    return 1;
+}
+
+/** @brief Service function comparing keys of @c *width symbols for qsort_r. */
+
+int wHash_keycmp (const void* a, const void* b, void* width)
+{
+    return wmemcmp (*(const wchar_t* const*)a, *(const wchar_t* const*)b, *(const unsigned*)width);
+}
+
+/** @brief Service function sorting the keys of the table, putting their number to @b n.
+ *
+ * @return NULL if fails, array of pointers to the keys in order otherwise, to be freed.
+ */
+
+const wchar_t** wHash_sorted (const struct wHash* hs, uint64_t* n)
+{
+    const wchar_t** sorted = malloc ((hs -> nkeys + 1) * sizeof (wchar_t*));
+    if (!sorted) return NULL;
+
+    *n = 0;
+    for (uint64_t i = 0; i <= hs -> mask; i++)
+        if (hs -> counts[i]) sorted[(*n)++] = hs -> keys + i * hs -> width;
+    qsort_r (sorted, *n, sizeof (wchar_t*), wHash_keycmp, (void*)&hs -> width);
+    return sorted;
+}
+
+/** @brief Service function spilling the windows of the table in order with their counts to a new run,
+ * and emptying the table.
+ *
+ * A run is a temporary file, removed once closed (see tmpfile), of records of a window of @c width
+ * symbols followed by its count.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wHash_spill (struct wHash* hs)
+{
+    unsigned width = hs -> width;
+    uint64_t n = 0;
+    const wchar_t** sorted = wHash_sorted (hs, &n);
+    FILE** runs = sorted ? realloc (hs -> runs, (hs -> nruns + 1) * sizeof (FILE*)) : NULL;
+    if (runs) hs -> runs = runs;
+    FILE* run = runs ? tmpfile () : NULL;
+    if (run) hs -> runs[hs -> nruns++] = run;
+
+    int ok = run != NULL;
+    for (uint64_t k = 0; ok && k < n; k++)
+    {
+        const unsigned long* count = hs -> counts + (sorted[k] - hs -> keys) / width;
+        ok = fwrite (sorted[k], sizeof (wchar_t), width, run) == width &&
+             fwrite (count, sizeof (unsigned long), 1, run) == 1;
+    }
+    ok = ok && fflush (run) == 0 && fseek (run, 0, SEEK_SET) == 0;
+    free (sorted);
+    _PRECONDITION (ok, E_WHASH_IO, return 0);
+
+    memset (hs -> counts, 0, (hs -> mask + 1) * sizeof (unsigned long));
+    hs -> nkeys = 0;
+    return 1;
+}
+
+/** @brief Service function counting one more occurrence of the window at @b key, whose hash is in @c roll.
+ *
+ * @return 0 if fails to grow the table, 1 otherwise.
+ */
+
+static inline int wHash_count (struct wHash* hs, const wchar_t* key)
+{
+    unsigned width = hs -> width;
+    uint64_t slot = wHash_slot (hs, hs -> roll);
+    for (; hs -> counts[slot]; slot = (slot + 1) & hs -> mask)
+    {
+        const wchar_t* stored = hs -> keys + slot * width;
+        if (stored[0] == key[0] && wmemcmp (stored, key, width) == 0)
+        {
+            hs -> counts[slot]++;
+            hs -> npos++;
+            return 1;
+        }
+    }
+
+    hs -> counts[slot] = 1;
+    wmemcpy (hs -> keys + slot * width, key, width);
+    hs -> npos++;
+    // Load factor stays below 3/4; growing takes the old slots and twice as many new ones
+    if (4 * ++hs -> nkeys <= 3 * (hs -> mask + 1)) return 1;
+    uint64_t bytes = 3 * (hs -> mask + 1) * (sizeof (unsigned long) + width * sizeof (wchar_t));
+    return (hs -> budget && bytes > hs -> budget) ? wHash_spill (hs) : wHash_grow (hs);
+}
+
+/** @brief Service function feeding one symbol: puts it into the history and counts the window which ends
+ * WMARKOV_LAG symbols before it, if there is one.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+static inline int wHash_push (struct wHash* hs, wchar_t wch)
+{
+    unsigned width = hs -> width;
+    if (hs -> nhist == hs -> caphist)
+    {
+        size_t keep = width + WMARKOV_LAG;
+        memmove (hs -> hist, hs -> hist + hs -> nhist - keep, keep * sizeof (wchar_t));
+        hs -> nhist = keep;
+    }
+    hs -> hist[hs -> nhist++] = wch;
+    if (++hs -> seen <= WMARKOV_LAG) return 1;
+
+    // The symbol entering the window and its position in the text
+    const wchar_t* last = hs -> hist + hs -> nhist - 1 - WMARKOV_LAG;
+    uint64_t pos = hs -> seen - 1 - WMARKOV_LAG;
+    hs -> roll = hs -> roll * WHASH_MULT + (uint32_t)*last;
+    if (pos >= width) hs -> roll -= hs -> pow * (uint32_t)last[-(long)width];
+
+    if (pos + 1 < width)
+    {
+        if (pos + 1 == hs -> context)
+        {
+            wmemcpy (hs -> first, last + 1 - hs -> context, hs -> context);
+            hs -> hasfirst = true;
+        }
+        return 1;
+    }
+    return wHash_count (hs, last + 1 - width);
+}
+
+/** @brief Service function starting a line counted as a document: the window is all boundaries. */
+
+void wHash_newline (struct wHash* hs)
+{
+    wmemset (hs -> hist, WALPHA_BOUNDARY, hs -> width);
+    hs -> nhist   = hs -> width;
+    hs -> roll    = 0;
+    hs -> midline = false;
+}
+
+/** @brief Service function feeding one symbol of lines counted as documents, see wMarkov_trainer_lines:
+ * counts the window it ends at once, or the window ending the line with a boundary if it is @b newline.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+static inline int wHash_pushline (struct wHash* hs, wchar_t wch, wchar_t newline)
+{
+    unsigned width = hs -> width;
+    bool end = (wch == newline);
+    if (end && !hs -> midline) return 1;
+    if (end) wch = WALPHA_BOUNDARY;
+
+    if (hs -> nhist == hs -> caphist)
+    {
+        memmove (hs -> hist, hs -> hist + hs -> nhist - width, width * sizeof (wchar_t));
+        hs -> nhist = width;
+    }
+    hs -> roll = hs -> roll * WHASH_MULT + (uint32_t)wch - hs -> pow * (uint32_t)hs -> hist[hs -> nhist - width];
+    hs -> hist[hs -> nhist++] = wch;
+    hs -> seen++;
+    hs -> midline = true;
+
+    int ok = wHash_count (hs, hs -> hist + hs -> nhist - width);
+    if (end) wHash_newline (hs);
+    return ok;
+}
+
+/** @brief Feeds the next chunk of the text to the table.
+ *
+ * @return 0 if fails, now or with previous chunks, 1 otherwise.
+ */
+
+int wHash_feed (struct wHash* hs, const wchar_t* chunk, size_t n)
+{
+    _PRECONDITION_CHEAP ((hs && (chunk || !n)), E_WTRIE_NULLPOINTER, return 0);
+
+    if (!hs -> counts) return 0;
+    wchar_t newline = hs -> lines ? (wchar_t)wAlpha_id (hs -> lines, L'\n') : WALPHA_BOUNDARY;
+    for (size_t i = 0; i < n; i++)
+        if (!(hs -> lines ? wHash_pushline (hs, chunk[i], newline) : wHash_push (hs, chunk[i])))
+        {
+            wHash_free (hs);
+            return 0;
+        }
+    return 1;
+}
+
+/** @brief Ends the current line of a table counting lines as documents, unless it is empty.
+ *
+ * @return 0 if fails, now or before, 1 otherwise.
+ */
+
+int wHash_endline (struct wHash* hs)
+{
+    if (!hs -> counts) return 0;
+    if (!hs -> lines || wHash_pushline (hs, WALPHA_BOUNDARY, WALPHA_BOUNDARY)) return 1;
+    wHash_free (hs);
+    return 0;
+}
+
+/** @brief Service function finding the word of @b node among the words of @b depth symbols of the trie.
+ *
+ * Pointers to parents are not supported, so this searches the trie down to @b depth with an explicit
+ * stack, which takes time proportional to the size of the trie.
+ *
+ * @return 0 if fails, 1 otherwise, with the word in @b word.
+ */
+
+int wHash_word (struct wTrie* root, struct wTrie* node, unsigned depth, wchar_t* word)
+{
+    if (node == root) return 1;
+    if (!depth) return 0;
+
+    struct wTrie** path = malloc ((depth + 1) * sizeof (struct wTrie*));
+    unsigned* next = calloc (depth + 1, sizeof (unsigned));
+    int found = 0;
+    unsigned d = 0;
+    if (path && next) path[0] = root;
+    while (path && next && !found)
+    {
+        if (next[d] >= path[d] -> nkids)
+        {
+            if (!d) break;
+            d--;
+            continue;
+        }
+
+        struct wTrie* kid = wTrie_kid (path[d], next[d]++);
+        word[d] = kid -> wc;
+        if (d + 1 == depth)
+            found = (kid == node);
+        else
+        {
+            path[++d] = kid;
+            next[d] = 0;
+        }
+    }
+
+    free (path);
+    free (next);
+    return found;
+}
+
+/** @brief Constructor of tables going on from the state of the trainer @b tr.
+ *
+ * The window of the trainer and the symbols it holds back are fed to the table first, so the table counts
+ * what the trainer would if fed the same text. A trainer of lines has none, the table counts lines as
+ * documents for it, see wMarkov_trainer_lines. The trainer shall not be fed until wHash_apply.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wHash_init (struct wHash* hs, const struct wMarkov_trainer* tr)
+{
+    _PRECONDITION_CHEAP ((hs && tr && tr -> ctx), E_WTRIE_NULLPOINTER, return 0);
+
+    memset (hs, 0, sizeof (struct wHash));
+    hs -> context = tr -> context;
+    hs -> width   = tr -> context + 1;
+    hs -> mask    = WHASH_SLOTS - 1;
+    hs -> caphist = WHASH_HIST > 2 * (hs -> width + WMARKOV_LAG) ? WHASH_HIST : 2 * (hs -> width + WMARKOV_LAG);
+    hs -> counts  = calloc (WHASH_SLOTS, sizeof (unsigned long));
+    hs -> keys    = malloc (WHASH_SLOTS * hs -> width * sizeof (wchar_t));
+    hs -> hist    = malloc (hs -> caphist * sizeof (wchar_t));
+    hs -> first   = malloc (tr -> context * sizeof (wchar_t));
+    hs -> pow     = 1;
+    hs -> budget  = tr -> budget;
+    for (unsigned j = 0; j < hs -> width; j++) hs -> pow *= WHASH_MULT;
+
+    wchar_t* word = malloc ((tr -> filled + 1) * sizeof (wchar_t));
+    int ok = hs -> counts && hs -> keys && hs -> hist && hs -> first && word;
+    if (ok && tr -> lines)
+    {
+        hs -> lines = tr -> alpha;
+        wHash_newline (hs);
+    }
+    else
+    {
+        ok = ok && wHash_word (tr -> root, tr -> ctx, tr -> filled, word);
+        ok = ok && wHash_feed (hs, word, tr -> filled) && wHash_feed (hs, tr -> lag, tr -> nlag);
+    }
+    hs -> npos = tr -> npos;
+    free (word);
+
+    if (!ok) wHash_free (hs);
+    _PRECONDITION (ok, E_WHASH_NOMEM, return 0);
+    return 1;
+}
+
+/** @brief Service function adding @b count transitions of the window at @b key to the trie of the trainer.
+ *
+ * @b path holds the nodes of the prefixes of @b prev, the window added before, if not NULL; it is looked up
+ * from the longest prefix the windows share, and updated to hold those of @b key.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wHash_put (struct wMarkov_trainer* tr, struct wTrie** path, const wchar_t* key, const wchar_t* prev,
+               unsigned long count)
+{
+    struct wTrie* root = tr -> root;
+    unsigned context = tr -> context;
+    unsigned j = 0;
+    if (prev)
+        while (j < context && key[j] == prev[j]) j++;
+    for (; j < context; j++)
+        if (!(path[j + 1] = wTrie_slchild (tr -> pool, root, path[j], key[j]))) return 0;
+
+    struct wTrie* trans = wTrie_slchild (tr -> pool, root, path[context], key[context]);
+    if (!trans) return 0;
+    path[context] -> term = true;
+    trans -> count += count;
+    return 1;
+}
+
+/** @brief Cursor of a run being merged, holding its current record. */
+
+struct wHash_run
+{
+    FILE*         file;     //!< The run.
+    wchar_t*      key;      //!< Window of the current record.
+    unsigned long count;    //!< Count of the current record.
+};
+
+/** @brief Service function reading the next record of the run.
+ *
+ * @return 0 at the end of the run or if fails to read, 1 otherwise.
+ */
+
+int wHash_runnext (struct wHash_run* run, unsigned width)
+{
+    return fread (run -> key, sizeof (wchar_t), width, run -> file) == width &&
+           fread (&run -> count, sizeof (unsigned long), 1, run -> file) == 1;
+}
+
+/** @brief Service function restoring the order of the heap of @b n runs from position @b i down. */
+
+void wHash_sift (struct wHash_run** heap, unsigned n, unsigned i, unsigned width)
+{
+    for (;;)
+    {
+        unsigned least = i;
+        unsigned kid = 2 * i + 1;
+        if (kid < n && wmemcmp (heap[kid] -> key, heap[least] -> key, width) < 0) least = kid;
+        if (kid + 1 < n && wmemcmp (heap[kid + 1] -> key, heap[least] -> key, width) < 0) least = kid + 1;
+        if (least == i) return;
+
+        struct wHash_run* swap = heap[i];
+        heap[i] = heap[least];
+        heap[least] = swap;
+        i = least;
+    }
+}
+
+/** @brief Service function merging the runs of the table into the trie of the trainer, see wHash_put.
+ *
+ * Runs are merged through a heap ordered by their current windows, so windows come out in order, and the
+ * counts of a window found in several runs are added up before it is put.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wHash_merge (struct wHash* hs, struct wMarkov_trainer* tr, struct wTrie** path)
+{
+    unsigned width = hs -> width;
+    unsigned nruns = hs -> nruns;
+    struct wHash_run* runs  = calloc (nruns, sizeof (struct wHash_run));
+    struct wHash_run** heap = malloc (nruns * sizeof (struct wHash_run*));
+    wchar_t* keys = malloc ((nruns + 2) * width * sizeof (wchar_t));
+    int ok = runs && heap && keys;
+
+    unsigned n = 0;
+    for (unsigned i = 0; ok && i < nruns; i++)
+    {
+        runs[i].file = hs -> runs[i];
+        runs[i].key  = keys + i * width;
+        if (wHash_runnext (&runs[i], width)) heap[n++] = &runs[i];
+    }
+    for (unsigned i = n / 2; ok && i-- > 0; ) wHash_sift (heap, n, i, width);
+
+    // Window being added up and the window put before it
+    wchar_t* acc  = ok ? keys + nruns * width : NULL;
+    wchar_t* prev = ok ? acc + width : NULL;
+    unsigned long count = 0;
+    bool has = false;
+    bool hasprev = false;
+    while (ok && n)
+    {
+        struct wHash_run* top = heap[0];
+        if (has && wmemcmp (top -> key, acc, width) == 0)
+            count += top -> count;
+        else
+        {
+            if (has)
+            {
+                ok = wHash_put (tr, path, acc, hasprev ? prev : NULL, count);
+                wchar_t* swap = prev;
+                prev = acc;
+                acc = swap;
+                hasprev = true;
+            }
+            wmemcpy (acc, top -> key, width);
+            count = top -> count;
+            has = true;
+        }
+        if (!wHash_runnext (top, width)) heap[0] = heap[--n];
+        if (n) wHash_sift (heap, n, 0, width);
+    }
+    ok = ok && (!has || wHash_put (tr, path, acc, hasprev ? prev : NULL, count));
+    for (unsigned i = 0; i < nruns; i++) ok = ok && !ferror (hs -> runs[i]);
+
+    free (runs);
+    free (heap);
+    free (keys);
+    return ok;
+}
+
+/** @brief Adds the counts of the table to the trie of the trainer and puts the trainer into the state of
+ * having been fed the text of the table. The table is freed.
+ *
+ * Windows are sorted and looked up in order with wTrie_slchild, each from the node of the longest prefix
+ * it shares with the previous one, so the trie gets the same nodes and links as if it was trained by the
+ * trainer, spawned in preorder at a cost of about one lookup per window. If the table has spilled runs,
+ * the rest of it is spilled too and its memory freed before the runs are merged, see wHash_merge.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wHash_apply (struct wHash* hs, struct wMarkov_trainer* tr)
+{
+    _PRECONDITION_CHEAP ((hs && tr && tr -> ctx), E_WTRIE_NULLPOINTER, return 0);
+
+    struct wTrie* root = tr -> root;
+    unsigned context = tr -> context;
+    struct wTrie** path = malloc ((context + 1) * sizeof (struct wTrie*));
+    int ok = hs -> counts && path;
+    if (ok) path[0] = root;
+
+    if (ok && hs -> nruns)
+    {
+        ok = wHash_spill (hs);
+        free (hs -> counts);
+        free (hs -> keys);
+        hs -> counts = NULL;
+        hs -> keys   = NULL;
+        ok = ok && wHash_merge (hs, tr, path);
+    }
+    else if (ok)
+    {
+        uint64_t n = 0;
+        const wchar_t** sorted = wHash_sorted (hs, &n);
+        ok = sorted != NULL;
+        for (uint64_t k = 0; ok && k < n; k++)
+            ok = wHash_put (tr, path, sorted[k], k ? sorted[k - 1] : NULL,
+                            hs -> counts[(sorted[k] - hs -> keys) / hs -> width]);
+        free (sorted);
+    }
+    free (path);
+
+    if (tr -> lines)
+    {
+        if (ok) tr -> npos = hs -> npos;
+        else tr -> ctx = NULL;
+        wHash_free (hs);
+        _PRECONDITION (ok, E_WTRIE_SPAWNFAILED, return 0);
+        return 1;
+    }
+
+    unsigned nlag   = hs -> seen < WMARKOV_LAG ? (unsigned)hs -> seen : WMARKOV_LAG;
+    uint64_t steps  = hs -> seen - nlag;
+    unsigned filled = steps < context ? (unsigned)steps : context;
+    const wchar_t* window = hs -> hist + hs -> nhist - nlag - filled;
+
+    struct wTrie* ctx = root;
+    for (unsigned j = 0; ok && ctx && j < filled; j++) ctx = wTrie_slchild (tr -> pool, root, ctx, window[j]);
+    ok = ok && ctx;
+    if (ok && !tr -> start && hs -> hasfirst)
+    {
+        struct wTrie* start = root;
+        for (unsigned j = 0; start && j < context; j++) start = wTrie_child (start, hs -> first[j], NULL);
+        tr -> start = start;
+        ok = start != NULL;
+    }
+
+    if (ok)
+    {
+        tr -> ctx    = ctx;
+        tr -> filled = filled;
+        tr -> nlag   = nlag;
+        tr -> npos   = hs -> npos;
+        wmemcpy (tr -> lag, hs -> hist + hs -> nhist - nlag, nlag);
+    }
+    else tr -> ctx = NULL;
+
+    wHash_free (hs);
+    _PRECONDITION (ok, E_WTRIE_SPAWNFAILED, return 0);
+    return 1;
+}
+
+/** @brief Service function feeding a chunk to the table @b arg, see wMarkov_readfile. */
+
+int wHash_feedchunk (void* arg, const wchar_t* chunk, size_t n)
+{
+    return wHash_feed (arg, chunk, n);
+}
+
+/** @brief Trains the trainer on the whole UTF-8 file through a table, see wHash_apply.
+ *
+ * Counting is sequential, @b nthreads is ignored. Slots of the table take @c tr -> budget bytes at most, if that
+ * is not 0, spilling to disk past it.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wHash_trainfile (struct wMarkov_trainer* tr, const char* in_fname, unsigned nthreads)
+{
+    _PRECONDITION_CHEAP ((tr && in_fname), E_WTRIE_NULLPOINTER, return 0);
+    (void)nthreads;
+
+    struct wHash hs;
+    if (!wHash_init (&hs, tr)) return 0;
+    if (!wMarkov_readfile (in_fname, tr -> alpha, wHash_feedchunk, &hs) || !wHash_endline (&hs))
+    {
+        wHash_free (&hs);
+        return 0;
+    }
+    return wHash_apply (&hs, tr);
+}
+
+/** @brief Bytes of memory taken by the table. */
+
+size_t wHash_bytes (const struct wHash* hs)
+{
+    return (hs -> mask + 1) * (sizeof (unsigned long) + hs -> width * sizeof (wchar_t)) +
+           (hs -> caphist + hs -> context) * sizeof (wchar_t);
+}
+
+static const struct wMarkov_backend wHash_backend = { "hash", wHash_trainfile }; //!< Counts in a wHash.
+
+#endif
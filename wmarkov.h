@@ -0,0 +1,1102 @@
+/**
+ * @file wmarkov.h
+ * @brief Markov model training over wTrie
+ *
+ * The model is a wTrie holding every context (a word of @c context symbols met in the text) as a
+ * terminating node. Children of a context node are transitions: symbols which followed that context in
+ * the text. Training only counts transitions in their @c count fields; probabilities are only computed
+ * from the counts once all the text has been counted, by freezing the trie, see wFrozen_freeze. No meta
+ * is used.
+ */
+
+#ifndef _WMARKOV_H_
+#define _WMARKOV_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <wchar.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wtrie.h"
+#include "wsnippets.h"
+#include "walpha.h"
+
+/** @brief Counts one more occurrence of @b wch following the context node @b ctx.
+ *
+ * Spawns the transition from @b pool if needed. Probabilities come from the counts once the trie is
+ * frozen, see wFrozen_freeze.
+ *
+ * @return Pointer to the transition node, NULL if fails.
+ */
+
+struct wTrie* wMarkov_count (struct wTrie_pool* pool, struct wTrie* root, struct wTrie* ctx, wchar_t wch)
+{
+    struct wTrie* trans = wTrie_slchild (pool, root, ctx, wch);
+    _PRECONDITION (trans, E_WTRIE_SPAWNFAILED, return NULL);
+
+    trans -> count++;
+
+    return trans;
+}
+
+#define WMARKOV_LAG   2           //!< Number of last symbols of the text which never follow a context.
+#define WMARKOV_CHUNK (1 << 16)     //!< Number of bytes read at once by wMarkov_trainfile.
+
+/** @brief State of training on a text which comes in chunks.
+ *
+ * The trainer slides a window of @c context symbols over the text: the context of the next position is the
+ * suffix of the transition just counted, so each position costs amortized O(1) trie walking instead of
+ * looking the context up from the root. The window is carried from chunk to chunk as the current context
+ * node, so chunks may be cut anywhere and memory use does not depend on the size of the text.
+ *
+ * Every position of the text, except for the last @c context + WMARKOV_LAG ones, contributes its context
+ * and the symbol following it. To know where the text ends, the last WMARKOV_LAG symbols fed are held back
+ * until more symbols come.
+ *
+ * A trainer may train lines of the text as separate documents instead, see wMarkov_trainer_lines.
+ */
+
+struct wMarkov_trainer
+{
+    struct wTrie_pool* pool;        //!< Pool to take new nodes from, NULL for calloc.
+    struct wTrie*      root;        //!< Root of the model.
+    unsigned           context;     //!< Length of contexts.
+    unsigned           filled;      //!< Number of symbols in the first window so far.
+    struct wTrie*      ctx;         //!< Node of the current context, NULL if training failed.
+    struct wTrie*      start;       //!< Node of the first context of the text, NULL until it is complete.
+    size_t             npos;        //!< Number of positions trained.
+    unsigned           nlag;        //!< Number of symbols held back.
+    wchar_t            lag[WMARKOV_LAG]; //!< Symbols held back.
+    struct wAlpha*     alpha;       //!< Alphabet whose IDs the trie holds instead of code points, NULL for none.
+    bool               lines;       //!< Whether lines are trained as separate documents.
+    size_t             budget;      //!< Bytes the hash table of the hash backend may take before spilling, 0 for
+                                    //!< no limit. The trie is not limited.
+};
+
+/** @brief Constructor of trainers. Should ALWAYS be called before feeding a trainer.
+ *
+ * New nodes are taken from @b pool, or allocated with calloc if @b pool is NULL.
+ *
+ * @warning @b root must be empty or trained by trainers only, see wTrie_slchild.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wMarkov_trainer_init (struct wMarkov_trainer* tr, struct wTrie_pool* pool, struct wTrie* root,
+                          unsigned context)
+{
+    _PRECONDITION_CHEAP ((tr && root), E_WTRIE_NULLPOINTER, return 0);
+    _PRECONDITION       (context,      E_WTRIE_EMPTYWORD,   return 0);
+
+    memset (tr, 0, sizeof (struct wMarkov_trainer));
+    tr -> pool    = pool;
+    tr -> root    = root;
+    tr -> context = context;
+    tr -> ctx     = root;
+    return 1;
+}
+
+/** @brief Switches a trainer which has not been fed yet to training lines of the text as documents.
+ *
+ * Every line then stands for a document of its own, between WALPHA_BOUNDARY symbols: contexts are made of
+ * boundaries before the line starts, and the line ends with a transition to a boundary, so no context
+ * spans two lines and the first context of the model, at which generation starts, is @c context
+ * boundaries. Newlines themselves are not trained, nor are empty lines, and the end of the text ends its
+ * last line. Such a trainer carries nothing from one line to the next, so any lines may be trained apart
+ * and in any order. Symbols must be IDs of an alphabet, whose ID 0 is the boundary. A count model saved
+ * in this mode stays in it, see wMarkov_load.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wMarkov_trainer_lines (struct wMarkov_trainer* tr)
+{
+    _PRECONDITION_CHEAP ((tr && tr -> ctx), E_WTRIE_NULLPOINTER, return 0);
+    if (tr -> lines) return 1;
+    _PRECONDITION ((tr -> alpha && !tr -> filled && !tr -> nlag), E_WMARKOV_LINES, return 0);
+
+    struct wTrie* ctx = tr -> root;
+    for (unsigned i = 0; ctx && i < tr -> context; i++)
+        ctx = wTrie_slchild (tr -> pool, tr -> root, ctx, WALPHA_BOUNDARY);
+    _PRECONDITION (ctx, E_WTRIE_SPAWNFAILED, return 0);
+
+    tr -> ctx    = ctx;
+    tr -> start  = ctx;
+    tr -> filled = tr -> context;
+    tr -> lines  = true;
+    return 1;
+}
+
+/** @brief Ends the current line of a trainer of lines, see wMarkov_trainer_lines, unless it is empty.
+ *
+ * @return 0 if training has failed, now or before, 1 otherwise.
+ */
+
+int wMarkov_endline (struct wMarkov_trainer* tr)
+{
+    _PRECONDITION_CHEAP ((tr && tr -> lines), E_WTRIE_NULLPOINTER, return 0);
+
+    if (tr -> ctx && tr -> ctx != tr -> start)
+    {
+        tr -> ctx -> term = true;
+        tr -> ctx = wMarkov_count (tr -> pool, tr -> root, tr -> ctx, WALPHA_BOUNDARY) ? tr -> start : NULL;
+        tr -> npos++;
+    }
+    return tr -> ctx != NULL;
+}
+
+/** @brief Service function feeding a chunk to a trainer of lines, see wMarkov_trainer_lines. */
+
+int wMarkov_feedlines (struct wMarkov_trainer* tr, const wchar_t* chunk, size_t n)
+{
+    wchar_t newline = (wchar_t)wAlpha_id (tr -> alpha, L'\n');
+    for (size_t i = 0; i < n && tr -> ctx; i++)
+    {
+        if (chunk[i] == newline)
+        {
+            wMarkov_endline (tr);
+            continue;
+        }
+
+        tr -> ctx -> term = true;
+        struct wTrie* trans = wMarkov_count (tr -> pool, tr -> root, tr -> ctx, chunk[i]);
+        tr -> ctx = trans ? trans -> suffix : NULL;
+        tr -> npos++;
+    }
+    return tr -> ctx != NULL;
+}
+
+/** @brief Service function training one symbol which is known not to be among the last ones. */
+
+void wMarkov_step (struct wMarkov_trainer* tr, wchar_t wch)
+{
+    if (tr -> filled < tr -> context)
+    {
+        tr -> ctx = wTrie_slchild (tr -> pool, tr -> root, tr -> ctx, wch);
+        if (++tr -> filled == tr -> context) tr -> start = tr -> ctx;
+        return;
+    }
+
+    tr -> ctx -> term = true;
+    struct wTrie* trans = wMarkov_count (tr -> pool, tr -> root, tr -> ctx, wch);
+    tr -> ctx = trans ? trans -> suffix : NULL;
+    tr -> npos++;
+}
+
+/** @brief Feeds the next chunk of the text to the trainer.
+ *
+ * A trainer of lines (see wMarkov_trainer_lines) is left in the middle of the last line of the chunk,
+ * which wMarkov_endline ends when the text is over.
+ *
+ * @return 0 if training has failed, now or with previous chunks, 1 otherwise.
+ */
+
+int wMarkov_feed (struct wMarkov_trainer* tr, const wchar_t* chunk, size_t n)
+{
+    _PRECONDITION_CHEAP ((tr && (chunk || !n)), E_WTRIE_NULLPOINTER, return 0);
+    if (tr -> lines) return wMarkov_feedlines (tr, chunk, n);
+
+    size_t i = 0;
+    for (; i < n && tr -> nlag < WMARKOV_LAG; i++)
+        tr -> lag[tr -> nlag++] = chunk[i];
+
+    if (i == n) return tr -> ctx != NULL;
+
+    for (unsigned k = 0; k < WMARKOV_LAG && tr -> ctx && i + k < n; k++)
+        wMarkov_step (tr, tr -> lag[k]);
+
+    if (n - i >= WMARKOV_LAG)
+    {
+        for (; i + WMARKOV_LAG < n && tr -> ctx; i++)
+            wMarkov_step (tr, chunk[i]);
+        memcpy (tr -> lag, chunk + n - WMARKOV_LAG, WMARKOV_LAG * sizeof (wchar_t));
+    }
+    else
+    {
+        unsigned left = n - i;
+        memmove (tr -> lag, tr -> lag + left, (WMARKOV_LAG - left) * sizeof (wchar_t));
+        memcpy (tr -> lag + WMARKOV_LAG - left, chunk + i, left * sizeof (wchar_t));
+    }
+
+    return tr -> ctx != NULL;
+}
+
+/** @brief Passes the bytes @b from .. @b to of the corpus decoded to @b feed in chunks of WMARKOV_CHUNK
+ * symbols at most, mapped to IDs of @b alpha unless it is NULL, see wMarkov_readfile. A sequence cut by
+ * @b to is decoded as malformed.
+ *
+ * @return 0 if @b feed fails, 1 otherwise.
+ */
+
+int wMarkov_readcorpus (const struct wCorpus* corpus, size_t from, size_t to, const struct wAlpha* alpha,
+                        int (*feed) (void*, const wchar_t*, size_t), void* arg)
+{
+    wchar_t* chunk = malloc (WMARKOV_CHUNK * sizeof (wchar_t));
+    int ok = chunk != NULL;
+    while (ok && from < to)
+    {
+        size_t end = (to - from > WMARKOV_CHUNK) ? from + WMARKOV_CHUNK : to;
+        size_t used = 0;
+        size_t n = wutf8_decode (chunk, corpus -> bytes + from, end - from, &used, end == to);
+        if (alpha) wAlpha_map (alpha, chunk, n);
+        ok = feed (arg, chunk, n);
+        from += used;
+    }
+
+    free (chunk);
+    return ok;
+}
+
+/** @brief Reads the whole UTF-8 file and passes it decoded to @b feed.
+ *
+ * Regular files are mapped as a wCorpus and decoded in place; others, such as pipes, are read in blocks
+ * of WMARKOV_CHUNK bytes, and as they can not be read twice, code points missing from @b alpha are added
+ * to it as they come, see wMarkov_alphabet. Either way a sequence cut by the end of a block is carried
+ * over to the next one, symbols are mapped to IDs of @b alpha unless it is NULL, and memory use is bounded
+ * by the size of the block, not of the file. @b feed gets @b arg, a chunk of symbols and their number,
+ * and returns 0 to stop reading.
+ *
+ * @return 0 if fails to read the file or @b feed fails, 1 otherwise.
+ */
+
+int wMarkov_readfile (const char* in_fname, struct wAlpha* alpha, int (*feed) (void*, const wchar_t*, size_t),
+                      void* arg)
+{
+    struct wCorpus corpus;
+    if (wCorpus_open (&corpus, in_fname))
+    {
+        int ok = wMarkov_readcorpus (&corpus, 0, corpus.size, alpha, feed, arg);
+        wCorpus_close (&corpus);
+        return ok;
+    }
+
+    int infd = open (in_fname, O_RDONLY);
+    if (infd < 0) return 0;
+
+    unsigned char* block = malloc (WMARKOV_CHUNK);
+    wchar_t*       chunk = malloc (WMARKOV_CHUNK * sizeof (wchar_t));
+    int ok = block && chunk;
+    size_t carry = 0;
+    ssize_t got  = 1;
+    while (ok && got > 0)
+    {
+        do got = read (infd, block + carry, WMARKOV_CHUNK - carry);
+        while (got < 0 && errno == EINTR);
+        if (got < 0) ok = 0;
+        if (!ok) break;
+
+        size_t have = carry + got;
+        size_t used = 0;
+        size_t n = wutf8_decode (chunk, block, have, &used, got == 0);
+        ok = (!alpha || wAlpha_mapadd (alpha, chunk, n)) && feed (arg, chunk, n);
+        carry = have - used;
+        memmove (block, block + used, carry);
+    }
+
+    free (block);
+    free (chunk);
+    close (infd);
+    return ok;
+}
+
+/** @brief Service function feeding a chunk to the trainer @b arg, see wMarkov_readfile. */
+
+int wMarkov_feedchunk (void* arg, const wchar_t* chunk, size_t n)
+{
+    return wMarkov_feed (arg, chunk, n);
+}
+
+/** @brief Feeds the whole UTF-8 file to the trainer, see wMarkov_readfile. The file ends the last line of a
+ * trainer of lines.
+ *
+ * @return 0 if fails to read the file or to train, 1 otherwise.
+ */
+
+int wMarkov_trainfile (struct wMarkov_trainer* tr, const char* in_fname)
+{
+    _PRECONDITION_CHEAP ((tr && in_fname), E_WTRIE_NULLPOINTER, return 0);
+
+    return wMarkov_readfile (in_fname, tr -> alpha, wMarkov_feedchunk, tr) && (!tr -> lines || wMarkov_endline (tr));
+}
+
+/** @brief Service function counting code points of a chunk into the array of counts @b arg, see
+ * wMarkov_alphabet.
+ */
+
+int wMarkov_freqchunk (void* arg, const wchar_t* chunk, size_t n)
+{
+    uint64_t* freq = arg;
+    for (size_t i = 0; i < n; i++)
+        if ((uint32_t)chunk[i] < WALPHA_CODES) freq[(uint32_t)chunk[i]]++;
+    return 1;
+}
+
+/** @brief Service function comparing pairs of a count and a code point for qsort, by descending count, then
+ * ascending code point.
+ */
+
+int wMarkov_freqcmp (const void* a, const void* b)
+{
+    const uint64_t* x = a;
+    const uint64_t* y = b;
+    if (x[0] != y[0]) return x[0] > y[0] ? -1 : 1;
+    return (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+/** @brief Adds the code points of the UTF-8 file missing from the alphabet to it, the most frequent first.
+ *
+ * Reads the file once more before training, see wMarkov_trainer::alpha. IDs of code points already in the
+ * alphabet do not change, so the alphabet of a count model can be extended with the symbols of new text.
+ * Files which can not be mapped are left unread, their code points are added in order of appearance by
+ * wMarkov_readfile while training instead.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wMarkov_alphabet (struct wAlpha* alpha, const char* in_fname)
+{
+    _PRECONDITION_CHEAP ((alpha && in_fname), E_WTRIE_NULLPOINTER, return 0);
+
+    struct wCorpus corpus;
+    if (!wCorpus_open (&corpus, in_fname)) return 1;
+
+    uint64_t* freq = calloc (WALPHA_CODES, sizeof (uint64_t));
+    int ok = freq && wMarkov_readcorpus (&corpus, 0, corpus.size, NULL, wMarkov_freqchunk, freq);
+    wCorpus_close (&corpus);
+    _PRECONDITION (freq, E_WALPHA_NOMEM, return 0);
+
+    size_t n = 0;
+    for (uint32_t code = 0; ok && code < WALPHA_CODES; code++)
+        n += freq[code] && !wAlpha_id (alpha, (wchar_t)code);
+
+    // Pairs of a count and a code point of the new symbols
+    uint64_t* pairs = ok ? malloc ((2 * n + 1) * sizeof (uint64_t)) : NULL;
+    ok = pairs != NULL;
+    n = 0;
+    for (uint32_t code = 0; ok && code < WALPHA_CODES; code++)
+        if (freq[code] && !wAlpha_id (alpha, (wchar_t)code))
+        {
+            pairs[2 * n]     = freq[code];
+            pairs[2 * n + 1] = code;
+            n++;
+        }
+    if (ok) qsort (pairs, n, 2 * sizeof (uint64_t), wMarkov_freqcmp);
+    for (size_t i = 0; ok && i < n; i++) ok = wAlpha_add (alpha, (wchar_t)pairs[2 * i + 1]) != 0;
+
+    free (pairs);
+    free (freq);
+    return ok;
+}
+
+#define WMARKOV_SHARD_MIN (1 << 20) //!< Minimal number of bytes of the text per thread of wMarkov_trainpar.
+
+/** @brief Part of the text trained by one thread of wMarkov_trainpar into its own tree. */
+
+struct wMarkov_shard
+{
+    struct wTrie_pool         pool;     //!< Pool of the tree, unused by the first shard.
+    struct wMarkov_trainer    tr;       //!< Trainer of the tree.
+    const unsigned char*      text;     //!< The whole text.
+    size_t                    from;     //!< First byte of the part.
+    size_t                    to;       //!< Byte past the part.
+    size_t                    size;     //!< Size of the whole text.
+    struct wMarkov_shard*     merged;   //!< Shard to merge into this one, NULL if none.
+    unsigned                  kidfrom;  //!< First child of the root to relink.
+    unsigned                  kidto;    //!< Child of the root past the last one to relink.
+    int                       ok;       //!< Whether training or merging succeeded.
+};
+
+/** @brief Service function training a shard, see wMarkov_trainpar. */
+
+void* wMarkov_shardrun (void* arg)
+{
+    struct wMarkov_shard* sh = arg;
+    if (sh -> tr.lines)
+    {
+        // Parts are cut at starts of lines, which need nothing from around them
+        struct wCorpus corpus = { sh -> text, sh -> size };
+        sh -> ok = wMarkov_readcorpus (&corpus, sh -> from, sh -> to, sh -> tr.alpha, wMarkov_feedchunk, &sh -> tr) &&
+                   wMarkov_endline (&sh -> tr);
+        WSTATS_FLUSH ();
+        return NULL;
+    }
+
+    wchar_t* chunk = malloc (WMARKOV_CHUNK * sizeof (wchar_t));
+    sh -> ok = chunk != NULL;
+
+    // Windows starting in the part need the next context + WMARKOV_LAG symbols after it.
+    size_t need = sh -> tr.context + WMARKOV_LAG;
+    size_t pos = sh -> from;
+    while (sh -> ok && pos < sh -> size && (pos < sh -> to || need))
+    {
+        size_t end = pos + WMARKOV_CHUNK < sh -> size ? pos + WMARKOV_CHUNK : sh -> size;
+        if (pos < sh -> to && end > sh -> to) end = sh -> to;
+
+        size_t used = 0;
+        size_t n = wutf8_decode (chunk, sh -> text + pos, end - pos, &used, end == sh -> to || end == sh -> size);
+        if (sh -> tr.alpha) wAlpha_map (sh -> tr.alpha, chunk, n);
+        if (pos >= sh -> to)
+        {
+            if (n > need) n = need;
+            need -= n;
+        }
+        sh -> ok = wMarkov_feed (&sh -> tr, chunk, n);
+        pos += used;
+    }
+
+    free (chunk);
+    WSTATS_FLUSH ();
+    return NULL;
+}
+
+/** @brief Service function merging the tree of @c sh -> merged into the tree of a shard. */
+
+void* wMarkov_shardmerge (void* arg)
+{
+    struct wMarkov_shard* sh = arg;
+    struct wMarkov_shard* src = sh -> merged;
+    sh -> ok = sh -> ok && src -> ok && wTrie_merge (sh -> tr.pool, sh -> tr.root, src -> tr.root);
+    wTrie_pool_absorb (sh -> tr.pool, &src -> pool);
+    sh -> tr.npos += src -> tr.npos;
+    WSTATS_FLUSH ();
+    return NULL;
+}
+
+/** @brief Service function restoring suffix links of a range of subtrees of the root, see wTrie_relink.
+ *
+ * Relinking a subtree only reads children arrays of others, so subtrees are relinked in parallel.
+ */
+
+void* wMarkov_shardrelink (void* arg)
+{
+    struct wMarkov_shard* sh = arg;
+    struct wTrie* root = sh -> tr.root;
+    for (unsigned i = sh -> kidfrom; i < sh -> kidto; i++)
+    {
+        struct wTrie* kid = wTrie_kid (root, i);
+        kid -> suffix = root;
+        wTrie_relink (root, kid);
+    }
+    WSTATS_FLUSH ();
+    return NULL;
+}
+
+/** @brief Service function running @b fn on @b n shards in parallel, in place of any thread failing to start. */
+
+void wMarkov_shardrunall (void* (*fn) (void*), struct wMarkov_shard** shards, unsigned n)
+{
+    pthread_t* threads = calloc (n, sizeof (pthread_t));
+    char*      started = calloc (n, 1);
+    for (unsigned i = 0; i < n; i++)
+        if (!threads || !started || pthread_create (&threads[i], NULL, fn, shards[i]) != 0) fn (shards[i]);
+        else started[i] = 1;
+
+    for (unsigned i = 0; i < n; i++)
+        if (started && started[i]) pthread_join (threads[i], NULL);
+    free (threads);
+    free (started);
+}
+
+/** @brief Service function putting the trainer into the state of having been fed @b text up to @b size.
+ *
+ * The current context is looked up by the last @c context symbols before the last WMARKOV_LAG ones, which
+ * are decoded from the end of the text, starting from a byte which starts a symbol and not earlier than
+ * @b from. The text must have at least @c context + WMARKOV_LAG symbols after @b from.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wMarkov_resume (struct wMarkov_trainer* tr, const unsigned char* text, size_t from, size_t size)
+{
+    size_t need = tr -> context + WMARKOV_LAG;
+    size_t back = 4 * need;
+    size_t n = 0;
+    wchar_t* tail = NULL;
+    for (;;)
+    {
+        size_t begin = (size - from > back) ? size - back : from;
+        while (begin < size && (text[begin] & 0xC0) == 0x80) begin++;
+
+        wchar_t* grown = realloc (tail, (size - begin + 1) * sizeof (wchar_t));
+        if (!grown) break;
+        tail = grown;
+        n = wutf8_decode (tail, text + begin, size - begin, NULL, 1);
+        if (n >= need || begin == from) break;
+        back *= 2;
+    }
+    if (tail && tr -> alpha) wAlpha_map (tr -> alpha, tail, n);
+
+    struct wTrie* ctx = (n >= need) ? tr -> root : NULL;
+    for (size_t i = n - need; ctx && i < n - WMARKOV_LAG; i++)
+        ctx = wTrie_child (ctx, tail[i], NULL);
+
+    if (ctx)
+    {
+        tr -> ctx    = ctx;
+        tr -> filled = tr -> context;
+        tr -> nlag   = WMARKOV_LAG;
+        memcpy (tr -> lag, tail + n - WMARKOV_LAG, WMARKOV_LAG * sizeof (wchar_t));
+    }
+    free (tail);
+    _PRECONDITION (ctx, E_WTRIE_CORRUPT, return 0);
+    return 1;
+}
+
+/** @brief Trains the model on the whole UTF-8 file with up to @b nthreads threads.
+ *
+ * The file is mapped and cut into one part per thread, at least WMARKOV_SHARD_MIN bytes each, on bytes
+ * which start a symbol. Each thread trains a tree of its own on the windows starting in its part, reading
+ * @c context + WMARKOV_LAG symbols past its end to complete them. The trees are merged pairwise in
+ * parallel into @b root, which yields exactly the counts of training on the whole file with a single
+ * trainer, and suffix links are rebuilt at last, also in parallel. Trains on a single thread for small
+ * files, and falls back to wMarkov_trainfile for files which can not be mapped.
+ *
+ * @b tr shall use a pool. It may have been trained already: the first part is fed to @b tr itself, so the
+ * file continues the text trained before. Afterwards @b tr is left in the state of having been fed the
+ * whole file, see wMarkov_resume, and can be fed more text. Trainers of lines cut parts at starts of lines
+ * instead, and their threads need not read past their parts nor resume, see wMarkov_trainer_lines.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wMarkov_trainpar (struct wMarkov_trainer* tr, const char* in_fname, unsigned nthreads)
+{
+    _PRECONDITION_CHEAP ((tr && tr -> pool && in_fname), E_WTRIE_NULLPOINTER, return 0);
+
+    struct wCorpus corpus;
+    if (!wCorpus_open (&corpus, in_fname)) return wMarkov_trainfile (tr, in_fname);
+
+    const unsigned char* text = corpus.bytes;
+    size_t size = corpus.size;
+    size_t nshards = (size / WMARKOV_SHARD_MIN > nthreads) ? nthreads : size / WMARKOV_SHARD_MIN;
+    if (nshards <= 1)
+    {
+        int ok = wMarkov_readcorpus (&corpus, 0, size, tr -> alpha, wMarkov_feedchunk, tr) &&
+                 (!tr -> lines || wMarkov_endline (tr));
+        wCorpus_close (&corpus);
+        return ok;
+    }
+
+    struct wMarkov_shard*  shards = calloc (nshards, sizeof (struct wMarkov_shard));
+    struct wMarkov_shard** todo   = calloc (nshards, sizeof (struct wMarkov_shard*));
+    int ok = shards && todo;
+
+    size_t from = 0;
+    for (size_t i = 0; ok && i < nshards; i++)
+    {
+        struct wMarkov_shard* sh = shards + i;
+        size_t to = (i + 1 == nshards) ? size : size / nshards * (i + 1);
+        if (to < from) to = from;
+        if (tr -> lines)
+        {
+            const unsigned char* nl = memchr (text + to, '\n', size - to);
+            to = nl ? (size_t)(nl - text) + 1 : size;
+        }
+        while (to < size && (text[to] & 0xC0) == 0x80) to++;
+
+        sh -> text = text;
+        sh -> from = from;
+        sh -> to   = to;
+        sh -> size = size;
+        if (i == 0)
+            sh -> tr = *tr;
+        else
+        {
+            wTrie_pool_init (&sh -> pool, tr -> pool -> block_sz);
+            struct wTrie* root = wTrie_pool_node (&sh -> pool, L'\0', 0, NULL, 0);
+            ok = root && wMarkov_trainer_init (&sh -> tr, &sh -> pool, root, tr -> context);
+            sh -> tr.alpha = tr -> alpha;
+            ok = ok && (!tr -> lines || wMarkov_trainer_lines (&sh -> tr));
+        }
+        todo[i] = sh;
+        from = to;
+    }
+
+    if (ok)
+    {
+        wMarkov_shardrunall (wMarkov_shardrun, todo, nshards);
+
+        for (size_t step = 1; step < nshards; step *= 2)
+        {
+            unsigned n = 0;
+            for (size_t i = 0; i + step < nshards; i += 2 * step)
+            {
+                shards[i].merged = shards + i + step;
+                todo[n++] = shards + i;
+            }
+            wMarkov_shardrunall (wMarkov_shardmerge, todo, n);
+        }
+        ok = shards[0].ok;
+    }
+
+    if (ok)
+    {
+        unsigned nkids = tr -> root -> nkids;
+        for (size_t i = 0; i < nshards; i++)
+        {
+            shards[i].tr.root = tr -> root;
+            shards[i].kidfrom = (unsigned)((uint64_t)nkids * i / nshards);
+            shards[i].kidto   = (unsigned)((uint64_t)nkids * (i + 1) / nshards);
+            todo[i] = shards + i;
+        }
+        wMarkov_shardrunall (wMarkov_shardrelink, todo, nshards);
+
+        *tr = shards[0].tr;
+        ok = tr -> lines || wMarkov_resume (tr, text, shards[nshards - 1].from, size);
+    }
+
+    for (size_t i = 1; shards && i < nshards; i++) wTrie_pool_absorb (tr -> pool, &shards[i].pool);
+    free (shards);
+    free (todo);
+    wCorpus_close (&corpus);
+    return ok;
+}
+
+/** @brief Way of counting the transitions of a text into a trainer.
+ *
+ * Backends differ in how they count while reading the text, but all leave the trainer in the same state,
+ * with the same counts in its trie, so saving, pruning and freezing do not depend on the backend. The trie
+ * backend is wMarkov_trainpar, see whash.h for another one.
+ */
+
+struct wMarkov_backend
+{
+    const char* name;   //!< Name of the backend.
+    int (*train) (struct wMarkov_trainer* tr, const char* in_fname, unsigned nthreads); //!< Trains on the file.
+};
+
+static const struct wMarkov_backend wMarkov_trie = { "trie", wMarkov_trainpar }; //!< Counts in the trie itself.
+
+/** @brief What wMarkov_prune has removed. */
+
+struct wMarkov_pruned
+{
+    size_t edges;   //!< Number of transitions removed.
+    size_t nodes;   //!< Number of nodes removed, transitions included.
+    size_t bytes;   //!< Number of bytes of pool memory returned to the system.
+};
+
+/** @brief Service function comparing counts for qsort in descending order. */
+
+int wMarkov_countcmp (const void* a, const void* b)
+{
+    unsigned long x = *(const unsigned long*)a;
+    unsigned long y = *(const unsigned long*)b;
+    return (x < y) - (x > y);
+}
+
+/** @brief Service function returning the code point of the symbol @b wc of a trie holding IDs of
+ * @b alpha, or code points if it is NULL.
+ */
+
+static inline unsigned long wMarkov_code (const struct wAlpha* alpha, wchar_t wc)
+{
+    return (alpha && (uint32_t)wc <= alpha -> n) ? (unsigned long)alpha -> code[wc] : (unsigned long)wc;
+}
+
+/** @brief Service function finding the count of the @b topk -th most frequent transition of @b ctx.
+ *
+ * Ties of that count are broken by code points rather than by symbols, so pruned models do not depend on
+ * how symbols are numbered: sets @b *lastcode to the largest code point among the transitions of that
+ * count kept along with the more frequent ones, see wMarkov_code.
+ *
+ * @return The count, 0 if the context has no more than @b topk transitions.
+ */
+
+unsigned long wMarkov_topcount (struct wTrie* ctx, unsigned topk, const struct wAlpha* alpha,
+                                unsigned long** scratch, unsigned* cap, unsigned long* lastcode)
+{
+    *lastcode = 0;
+    if (!topk || ctx -> nkids <= topk) return 0;
+
+    if (ctx -> nkids > *cap)
+    {
+        unsigned long* grown = realloc (*scratch, ctx -> nkids * sizeof (unsigned long));
+        if (!grown) return ULONG_MAX;
+        *scratch = grown;
+        *cap = ctx -> nkids;
+    }
+    for (unsigned i = 0; i < ctx -> nkids; i++) (*scratch)[i] = wTrie_kid (ctx, i) -> count;
+    qsort (*scratch, ctx -> nkids, sizeof (unsigned long), wMarkov_countcmp);
+
+    unsigned long least = (*scratch)[topk - 1];
+    unsigned ties = 0;
+    for (unsigned i = topk; i-- > 0 && (*scratch)[i] == least; ) ties++;
+
+    unsigned n = 0;
+    for (unsigned i = 0; i < ctx -> nkids; i++)
+        if (wTrie_kid (ctx, i) -> count == least) (*scratch)[n++] = wMarkov_code (alpha, wTrie_kid (ctx, i) -> wc);
+    qsort (*scratch, n, sizeof (unsigned long), wMarkov_countcmp);
+    *lastcode = (*scratch)[n - ties];
+    return least;
+}
+
+/** @brief Prunes rare transitions of the model of the trainer to bound its memory.
+ *
+ * Transitions met less than @b min_count times are removed, and of every context only the @b topk most
+ * frequent transitions are kept, ties broken in order of code points; 0 disables either limit. Contexts left
+ * without transitions disappear, unless they are still needed as suffixes of others: the kept transitions
+ * are copied into a new tree taken from a fresh pool with wTrie_slchild, which brings along exactly the
+ * suffixes they need, and the old pool is released as a whole. Generation runs into the start again from
+ * transitions leading to contexts which were removed.
+ *
+ * The trainer keeps its state and may be fed more text afterwards; its root, current and first context
+ * are moved into the new tree, and its pool is replaced in place. If @b pruned is not NULL, fills it in.
+ *
+ * @return 0 if fails, leaving the model as it was, 1 otherwise.
+ */
+
+int wMarkov_prune (struct wMarkov_trainer* tr, unsigned long min_count, unsigned topk, struct wMarkov_pruned* pruned)
+{
+    _PRECONDITION_CHEAP ((tr && tr -> pool && tr -> ctx), E_WTRIE_NULLPOINTER, return 0);
+
+    struct wTrie_pool fresh;
+    wTrie_pool_init (&fresh, tr -> pool -> block_sz);
+    struct wTrie* root = wTrie_pool_node (&fresh, L'\0', 0, NULL, 0);
+
+    // The old tree is no deeper than context + 1: contexts and their transitions
+    unsigned context = tr -> context;
+    struct wTrie** oldpath = malloc ((context + 2) * sizeof (struct wTrie*));
+    struct wTrie** newpath = malloc ((context + 2) * sizeof (struct wTrie*));
+    unsigned*      next    = malloc ((context + 2) * sizeof (unsigned));
+    unsigned long* scratch = NULL;
+    unsigned       cap     = 0;
+    struct wTrie*  ctx     = NULL;
+    struct wTrie*  start   = NULL;
+    size_t         edges   = 0;
+    int ok = root && oldpath && newpath && next;
+
+    unsigned depth = 0;
+    if (ok)
+    {
+        oldpath[0] = tr -> root;
+        newpath[0] = root;
+        next[0]    = 0;
+    }
+    while (ok)
+    {
+        struct wTrie* node = oldpath[depth];
+        bool ends = node == tr -> ctx || node == tr -> start;
+        bool leaf = depth == context;
+        if (!next[depth] && (ends || leaf))
+        {
+            unsigned long lastcode = 0;
+            unsigned long least = leaf ? wMarkov_topcount (node, topk, tr -> alpha, &scratch, &cap, &lastcode) : 0;
+            ok = least != ULONG_MAX;
+
+            for (unsigned i = 0; ok && i < (leaf ? node -> nkids : 0); i++)
+            {
+                struct wTrie* trans = wTrie_kid (node, i);
+                bool keep = trans -> count >= min_count &&
+                            (trans -> count > least ||
+                             (trans -> count == least && wMarkov_code (tr -> alpha, trans -> wc) <= lastcode));
+                if (!keep)
+                {
+                    edges++;
+                    continue;
+                }
+
+                // Spawns the path to the context on its first kept transition
+                for (unsigned d = 1; ok && d <= depth; d++)
+                    if (!newpath[d]) ok = (newpath[d] = wTrie_slchild (&fresh, root, newpath[d - 1], oldpath[d] -> wc)) != NULL;
+                struct wTrie* copy = ok ? wTrie_slchild (&fresh, root, newpath[depth], trans -> wc) : NULL;
+                ok = copy != NULL;
+                if (ok)
+                {
+                    copy -> count = trans -> count;
+                    newpath[depth] -> term = true;
+                }
+            }
+
+            for (unsigned d = 1; ok && ends && d <= depth; d++)
+                if (!newpath[d]) ok = (newpath[d] = wTrie_slchild (&fresh, root, newpath[d - 1], oldpath[d] -> wc)) != NULL;
+            if (ok && node == tr -> ctx)   ctx   = newpath[depth];
+            if (ok && node == tr -> start) start = newpath[depth];
+        }
+
+        if (ok && !leaf && next[depth] < node -> nkids)
+        {
+            oldpath[depth + 1] = wTrie_kid (node, next[depth]++);
+            newpath[depth + 1] = NULL;
+            next[++depth]      = 0;
+        }
+        else if (depth)
+            depth--;
+        else
+            break;
+    }
+
+    free (oldpath);
+    free (newpath);
+    free (next);
+    free (scratch);
+    if (!ok || !ctx || (tr -> start && !start))
+    {
+        wTrie_pool_free (&fresh);
+        errno = E_WTRIE_SPAWNFAILED;
+        return 0;
+    }
+
+    if (pruned)
+    {
+        pruned -> edges = edges;
+        pruned -> nodes = tr -> pool -> nnodes - fresh.nnodes;
+        pruned -> bytes = tr -> pool -> nbytes > fresh.nbytes ? tr -> pool -> nbytes - fresh.nbytes : 0;
+    }
+    wTrie_pool_free (tr -> pool);
+    *tr -> pool = fresh;
+    tr -> root  = root;
+    tr -> ctx   = ctx;
+    tr -> start = start;
+    return 1;
+}
+
+#define WMARKOV_MAGIC   "MFCOUNTS"  //!< First bytes of count model files.
+#define WMARKOV_VERSION 2           //!< Version of count model files written by wMarkov_save.
+
+/** @brief Header of count model files.
+ *
+ * A count model file keeps the whole trie with raw counts and the state of its trainer, so training can go
+ * on with more text later as if the texts had been joined, see wMarkov_load. The header is followed by
+ * @c nnodes records of nodes in preorder, children in order of symbols, then by the code points of IDs 1
+ * to @c nalpha of the alphabet as 32-bit numbers, in the native byte order of the saving machine, which is
+ * checked on loading. Version 1 files, which have no alphabet, are read as well.
+ */
+
+struct wMarkov_header
+{
+    char     magic[8];  //!< WMARKOV_MAGIC without the terminating null.
+    uint32_t version;   //!< WMARKOV_VERSION.
+    uint32_t byteorder; //!< 0x01020304 as written by the saving machine.
+    uint32_t context;   //!< Length of contexts.
+    uint32_t filled;    //!< Number of symbols in the first window of the trainer.
+    uint32_t nlag;      //!< Number of symbols held back by the trainer.
+    uint32_t lag[WMARKOV_LAG]; //!< Symbols held back by the trainer.
+    uint32_t nalpha;    //!< Number of symbols of the alphabet, 0 if the trie holds code points. Zero in version 1.
+    uint64_t npos;      //!< Number of positions trained.
+    uint64_t nnodes;    //!< Number of node records, the root included.
+    uint64_t ctx;       //!< Preorder index of the current context node.
+    uint64_t start;     //!< Preorder index of the first context node, UINT64_MAX if there is none.
+};
+
+#define WMARKOV_TERM 0x80000000u    //!< Bit of wMarkov_record::nkids set for terminating nodes.
+
+/** @brief Record of a node in count model files. */
+
+struct wMarkov_record
+{
+    uint64_t count;     //!< Count of the node.
+    uint32_t wc;        //!< Symbol of the node.
+    uint32_t nkids;     //!< Number of children, ORed with WMARKOV_TERM if the node is terminating.
+};
+
+/** @brief Saves the trie of the trainer with its counts, its alphabet and the state of the trainer to a count
+ * model file.
+ *
+ * The file is written under a temporary name and renamed over @b out_fname only when complete, so the old
+ * file survives a failed save. Nodes are walked with an explicit stack.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wMarkov_save (const struct wMarkov_trainer* tr, const char* out_fname)
+{
+    _PRECONDITION_CHEAP ((tr && tr -> ctx && out_fname), E_WTRIE_NULLPOINTER, return 0);
+
+    struct wMarkov_header hdr;
+    memset (&hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, WMARKOV_MAGIC, sizeof (hdr.magic));
+    hdr.version   = WMARKOV_VERSION;
+    hdr.byteorder = 0x01020304;
+    hdr.context   = tr -> context;
+    hdr.filled    = tr -> filled;
+    hdr.nlag      = tr -> nlag;
+    hdr.npos      = tr -> npos;
+    hdr.nalpha    = tr -> alpha ? tr -> alpha -> n : 0;
+    hdr.ctx       = UINT64_MAX;
+    hdr.start     = UINT64_MAX;
+    for (unsigned i = 0; i < WMARKOV_LAG; i++) hdr.lag[i] = (uint32_t)tr -> lag[i];
+
+    size_t namesz = strlen (out_fname) + 5;
+    char* tmp_fname = malloc (namesz);
+    _PRECONDITION (tmp_fname, E_WMARKOV_IO, return 0);
+    snprintf (tmp_fname, namesz, "%s.tmp", out_fname);
+
+    FILE* outfile = fopen (tmp_fname, "wb");
+    size_t depth = 0;
+    size_t cap = 64;
+    struct wTrie** nodes = malloc (cap * sizeof (struct wTrie*));
+    unsigned* next = malloc (cap * sizeof (unsigned));
+    int ok = outfile && nodes && next && fwrite (&hdr, sizeof (hdr), 1, outfile) == 1;
+
+    // Preorder: a node is written when pushed, its children are pushed one by one
+    struct wTrie* node = tr -> root;
+    while (ok && node)
+    {
+        struct wMarkov_record rec = { node -> count, (uint32_t)node -> wc,
+                                      node -> nkids | (node -> term ? WMARKOV_TERM : 0) };
+        if (node == tr -> ctx)   hdr.ctx   = hdr.nnodes;
+        if (node == tr -> start) hdr.start = hdr.nnodes;
+        hdr.nnodes++;
+        ok = fwrite (&rec, sizeof (rec), 1, outfile) == 1;
+
+        if (depth == cap)
+        {
+            cap *= 2;
+            struct wTrie** grown = realloc (nodes, cap * sizeof (struct wTrie*));
+            if (grown) nodes = grown;
+            unsigned* grown_next = grown ? realloc (next, cap * sizeof (unsigned)) : NULL;
+            if (grown_next) next = grown_next;
+            ok = ok && grown && grown_next;
+        }
+        nodes[depth]  = node;
+        next[depth++] = 0;
+
+        node = NULL;
+        while (ok && depth && !node)
+        {
+            if (next[depth - 1] < nodes[depth - 1] -> nkids)
+                node = wTrie_kid (nodes[depth - 1], next[depth - 1]++);
+            else
+                depth--;
+        }
+    }
+
+    for (uint32_t id = 1; ok && id <= hdr.nalpha; id++)
+    {
+        uint32_t code = (uint32_t)tr -> alpha -> code[id];
+        ok = fwrite (&code, sizeof (code), 1, outfile) == 1;
+    }
+
+    ok = ok && hdr.ctx != UINT64_MAX && fseek (outfile, 0, SEEK_SET) == 0 &&
+              fwrite (&hdr, sizeof (hdr), 1, outfile) == 1;
+    if (outfile && fclose (outfile) != 0) ok = 0;
+    ok = ok && rename (tmp_fname, out_fname) == 0;
+    if (!ok && outfile) unlink (tmp_fname);
+
+    free (nodes);
+    free (next);
+    free (tmp_fname);
+    _PRECONDITION (ok, E_WMARKOV_IO, return 0);
+    return 1;
+}
+
+/** @brief Loads a count model file saved with wMarkov_save into a new trie and initializes @b tr to go on
+ * training it.
+ *
+ * Nodes are taken from @b pool, suffix links are rebuilt with wTrie_relink. The alphabet of the model is
+ * loaded into @b alpha, which shall be empty and outlive the trainer, and the trainer uses it, or none if
+ * the model has none. Feeding the trainer more text
+ * then counts exactly what training on the saved text joined with the new one would, including the
+ * windows across the seam. A model trained on lines, whose first context is made of boundaries, is
+ * trained on lines again, see wMarkov_trainer_lines.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wMarkov_load (struct wMarkov_trainer* tr, struct wTrie_pool* pool, struct wAlpha* alpha, const char* in_fname)
+{
+    _PRECONDITION_CHEAP ((tr && pool && alpha && in_fname), E_WTRIE_NULLPOINTER, return 0);
+
+    FILE* infile = fopen (in_fname, "rb");
+    _PRECONDITION (infile, E_WMARKOV_IO, return 0);
+
+    struct wMarkov_header hdr;
+    if (fread (&hdr, sizeof (hdr), 1, infile) != 1 || memcmp (hdr.magic, WMARKOV_MAGIC, sizeof (hdr.magic)) != 0)
+    {
+        fclose (infile);
+        errno = E_WMARKOV_BADFILE;
+        return 0;
+    }
+    if (hdr.version != WMARKOV_VERSION && hdr.version != 1)
+    {
+        fclose (infile);
+        errno = E_WMARKOV_VERSION;
+        return 0;
+    }
+
+    struct wTrie* root = wTrie_pool_node (pool, L'\0', 0, NULL, 0);
+    int ok = root && hdr.byteorder == 0x01020304 && hdr.nnodes && hdr.ctx < hdr.nnodes &&
+             hdr.nlag <= WMARKOV_LAG && hdr.filled <= hdr.context &&
+             wMarkov_trainer_init (tr, pool, root, hdr.context);
+
+    size_t depth = 0;
+    size_t cap = 64;
+    struct wTrie** nodes = malloc (cap * sizeof (struct wTrie*));
+    unsigned* left = malloc (cap * sizeof (unsigned));
+    ok = ok && nodes && left;
+
+    for (uint64_t i = 0; ok && i < hdr.nnodes; i++)
+    {
+        struct wMarkov_record rec;
+        ok = fread (&rec, sizeof (rec), 1, infile) == 1;
+        if (!ok) break;
+
+        while (depth && !left[depth - 1]) depth--;
+        ok = (i == 0) == (depth == 0);
+        if (!ok) break;
+
+        struct wTrie* node = root;
+        if (i)
+        {
+            struct wTrie* parent = nodes[depth - 1];
+            node = wTrie_pool_node (pool, (wchar_t)rec.wc, 0, NULL, 0);
+            ok = node && (!parent -> nkids || wTrie_kidwc (parent, parent -> nkids - 1) < node -> wc) &&
+                 wTrie_adopt (pool, parent, node);
+            left[depth - 1]--;
+        }
+        if (!ok) break;
+
+        node -> count = rec.count;
+        node -> term  = (rec.nkids & WMARKOV_TERM) != 0;
+        if (i == hdr.ctx)   tr -> ctx   = node;
+        if (i == hdr.start) tr -> start = node;
+
+        if (depth == cap)
+        {
+            cap *= 2;
+            struct wTrie** grown = realloc (nodes, cap * sizeof (struct wTrie*));
+            if (grown) nodes = grown;
+            unsigned* grown_left = grown ? realloc (left, cap * sizeof (unsigned)) : NULL;
+            if (grown_left) left = grown_left;
+            ok = grown && grown_left;
+        }
+        if (ok && (rec.nkids & ~WMARKOV_TERM))
+        {
+            nodes[depth]  = node;
+            left[depth++] = rec.nkids & ~WMARKOV_TERM;
+        }
+    }
+    while (ok && depth && !left[depth - 1]) depth--;
+    ok = ok && !depth && (tr -> start != NULL) == (hdr.start != UINT64_MAX);
+
+    for (uint32_t id = 1; ok && id <= hdr.nalpha; id++)
+    {
+        uint32_t code;
+        ok = fread (&code, sizeof (code), 1, infile) == 1 && wAlpha_add (alpha, (wchar_t)code) == id;
+    }
+    ok = ok && fgetc (infile) == EOF;
+    if (ok && hdr.nalpha) tr -> alpha = alpha;
+    tr -> lines = tr -> alpha && tr -> start && tr -> start -> wc == WALPHA_BOUNDARY;
+
+    free (nodes);
+    free (left);
+    fclose (infile);
+    ok = ok && wTrie_relink (root, root);
+    _PRECONDITION (ok, E_WMARKOV_BADFILE, return 0);
+
+    tr -> filled = hdr.filled;
+    tr -> nlag   = hdr.nlag;
+    tr -> npos   = hdr.npos;
+    for (unsigned i = 0; i < WMARKOV_LAG; i++) tr -> lag[i] = (wchar_t)hdr.lag[i];
+    return 1;
+}
+
+#endif
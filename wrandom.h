@@ -0,0 +1,156 @@
+/**
+ * @file wrandom.h
+ * @brief Seedable pseudo-random generators for generation
+ *
+ * A wRandom is a small value holding the whole state of a generator, so any number of independent
+ * generators can run side by side, and a run is reproduced exactly from its seed. The default generator
+ * is xoshiro256**; defining WRANDOM_PCG before including this file switches to PCG64 (a 128-bit LCG with
+ * the XSL RR output) behind the same functions.
+ *
+ * Independent sequences for threads or documents are made two ways. wRandom_stream gives the sequence
+ * number @c idx of a seed directly, which is cheap enough to do for every document. wRandom_jump moves a
+ * generator 2^128 (xoshiro) or 2^96 (PCG) steps ahead, so sequences taken one jump apart are guaranteed
+ * not to overlap.
+ */
+
+#ifndef _WRANDOM_H_
+#define _WRANDOM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/** @brief State of a generator. Should ALWAYS be seeded with wRandom_seed or wRandom_stream before use. */
+
+struct wRandom
+{
+#ifdef WRANDOM_PCG
+    unsigned __int128 state;    //!< State of the LCG.
+    unsigned __int128 inc;      //!< Increment of the LCG, odd, selects the sequence.
+#else
+    uint64_t s[4];              //!< State of xoshiro256**, never all zero.
+#endif
+};
+
+#define WRANDOM_GOLDEN 0x9E3779B97F4A7C15ull    //!< Increment of splitmix64.
+
+/** @brief Service function: one step of splitmix64, used to spread seeds over the whole state. */
+
+static inline uint64_t wRandom_splitmix (uint64_t* x)
+{
+    uint64_t z = (*x += WRANDOM_GOLDEN);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+#ifdef WRANDOM_PCG
+
+#define WRANDOM_PCG_MULT (((unsigned __int128)0x2360ED051FC65DA4ull << 64) | 0x4385DF649FCCF645ull)
+
+/** @brief Returns the next 64 random bits. */
+
+static inline uint64_t wRandom_next (struct wRandom* rng)
+{
+    rng -> state = rng -> state * WRANDOM_PCG_MULT + rng -> inc;
+    uint64_t folded = (uint64_t)(rng -> state >> 64) ^ (uint64_t)rng -> state;
+    unsigned rot = (unsigned)(rng -> state >> 122);
+    return (folded >> rot) | (folded << ((64 - rot) & 63));
+}
+
+/** @brief Service function seeding sequence @b seq of the LCG from @b x. */
+
+void wRandom_init (struct wRandom* rng, uint64_t x, uint64_t seq)
+{
+    uint64_t y = seq;
+    rng -> inc   = ((((unsigned __int128)wRandom_splitmix (&y) << 64) | seq) << 1) | 1;
+    rng -> state = ((unsigned __int128)wRandom_splitmix (&x) << 64) | wRandom_splitmix (&x);
+    wRandom_next (rng);
+}
+
+/** @brief Moves the generator 2^96 steps ahead, by composing the LCG with itself in O(log) steps. */
+
+void wRandom_jump (struct wRandom* rng)
+{
+    unsigned __int128 mult = WRANDOM_PCG_MULT;
+    unsigned __int128 plus = rng -> inc;
+    for (unsigned bit = 0; bit < 96; bit++)
+    {
+        plus = (mult + 1) * plus;
+        mult = mult * mult;
+    }
+    rng -> state = mult * rng -> state + plus;
+}
+
+#else
+
+/** @brief Service function rotating @b x left by @b k bits. */
+
+static inline uint64_t wRandom_rotl (uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/** @brief Returns the next 64 random bits. */
+
+static inline uint64_t wRandom_next (struct wRandom* rng)
+{
+    uint64_t* s = rng -> s;
+    uint64_t result = wRandom_rotl (s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = wRandom_rotl (s[3], 45);
+    return result;
+}
+
+/** @brief Service function filling the state with splitmix64 from @b x. The sequence number is unused. */
+
+void wRandom_init (struct wRandom* rng, uint64_t x, uint64_t seq)
+{
+    (void)seq;
+    for (int i = 0; i < 4; i++) rng -> s[i] = wRandom_splitmix (&x);
+}
+
+/** @brief Moves the generator 2^128 steps ahead. */
+
+void wRandom_jump (struct wRandom* rng)
+{
+    static const uint64_t JUMP[] = { 0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull,
+                                     0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull };
+    uint64_t t[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++)
+        for (int b = 0; b < 64; b++)
+        {
+            if (JUMP[i] & ((uint64_t)1 << b))
+                for (int j = 0; j < 4; j++) t[j] ^= rng -> s[j];
+            wRandom_next (rng);
+        }
+    memcpy (rng -> s, t, sizeof (t));
+}
+
+#endif
+
+/** @brief Seeds the generator. Equal seeds give equal sequences. */
+
+void wRandom_seed (struct wRandom* rng, uint64_t seed)
+{
+    wRandom_init (rng, seed, 0);
+}
+
+/** @brief Seeds the generator with sequence number @b idx of @b seed.
+ *
+ * Sequences of different @b idx start from unrelated states: with xoshiro they come from disjoint runs of
+ * splitmix64, with PCG they are distinct sequences of the LCG. Costs the same as wRandom_seed.
+ */
+
+void wRandom_stream (struct wRandom* rng, uint64_t seed, uint64_t idx)
+{
+    uint64_t x = seed;
+    uint64_t mixed = wRandom_splitmix (&x);
+    wRandom_init (rng, mixed + 4 * WRANDOM_GOLDEN * (idx + 1), idx);
+}
+
+#endif
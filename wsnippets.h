@@ -1,10 +1,21 @@
+#ifndef _WSNIPPETS_H_
+#define _WSNIPPETS_H_
+
 #include <stdio.h>
 #include <wchar.h>
 #include <wctype.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define DFROMBGN  1
 #define DFROMEND -1
@@ -14,40 +25,380 @@ int fgetnwc (wchar_t* wbuff, int n, FILE* infile)
     assert (infile);
 
     int i = 0;
-    wchar_t winp = (wchar_t)fgetwc (infile);
-    for (i; winp != WEOF && (n? i < n : 1); i++)
+    wint_t winp = WEOF;
+    for (i; (n? i < n : 1) && (winp = fgetwc (infile)) != WEOF; i++)
     {
-        *(wbuff + i) = winp;
-        winp = (wchar_t)fgetwc (infile);
+        *(wbuff + i) = (wchar_t)winp;
     }
     return i;
 }
 
-wchar_t* wloadfile (const char* in_fname, wchar_t* wbuffer) 
+#define WUTF8_BAD 0xFFFD      //!< Code point stored in place of malformed input.
+
+/** @brief Service function storing @b n ASCII bytes as code points. */
+
+static inline void wutf8_ascii (wchar_t* wbuff, const unsigned char* src, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    if (sizeof (wchar_t) == 4)
+    {
+        const __m128i zero = _mm_setzero_si128 ();
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i v  = _mm_loadu_si128 ((const __m128i*)(src + i));
+            __m128i lo = _mm_unpacklo_epi8 (v, zero);
+            __m128i hi = _mm_unpackhi_epi8 (v, zero);
+            _mm_storeu_si128 ((__m128i*)(wbuff + i),      _mm_unpacklo_epi16 (lo, zero));
+            _mm_storeu_si128 ((__m128i*)(wbuff + i + 4),  _mm_unpackhi_epi16 (lo, zero));
+            _mm_storeu_si128 ((__m128i*)(wbuff + i + 8),  _mm_unpacklo_epi16 (hi, zero));
+            _mm_storeu_si128 ((__m128i*)(wbuff + i + 12), _mm_unpackhi_epi16 (hi, zero));
+        }
+    }
+#endif
+    for (; i < n; i++) wbuff[i] = src[i];
+}
+
+/** @brief Service function returning the length of the run of ASCII bytes at the beginning of @b src. */
+
+static inline size_t wutf8_asciirun (const unsigned char* src, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16)
+    {
+        int mask = _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i*)(src + i)));
+        if (mask) return i + __builtin_ctz (mask);
+    }
+#endif
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t word = 0;
+        memcpy (&word, src + i, 8);
+        if (word & 0x8080808080808080ull) break;
+    }
+    while (i < n && src[i] < 0x80) i++;
+    return i;
+}
+
+/** @brief Decodes a block of UTF-8 into code points.
+ *
+ * Runs of ASCII, the bulk of most texts, are found and widened 16 bytes at a time. Malformed input
+ * (stray continuations, overlong forms, surrogates, code points above U+10FFFF) becomes WUTF8_BAD, one
+ * per maximal invalid subpart as recommended by Unicode. A sequence cut by the end of the block is left undecoded unless @b last is set, so blocks
+ * can be cut anywhere: the caller should carry the @b used .. @b n bytes over to the next block.
+ * @b wbuff must have room for @b n code points.
+ *
+ * @return Number of code points stored, the number of bytes consumed is stored in @b used.
+ */
+
+size_t wutf8_decode (wchar_t* wbuff, const unsigned char* src, size_t n, size_t* used, int last)
+{
+    assert (wbuff && (src || !n));
+
+    size_t i = 0;
+    size_t k = 0;
+    while (i < n)
+    {
+        size_t run = wutf8_asciirun (src + i, n - i);
+        wutf8_ascii (wbuff + k, src + i, run);
+        i += run;
+        k += run;
+
+        for (; i < n && src[i] >= 0x80; k++)
+        {
+            unsigned char lead = src[i];
+            unsigned len  = 0;
+            uint32_t code = 0;
+            if      (lead >= 0xC2 && lead <= 0xDF) { len = 2; code = lead & 0x1F; }
+            else if (lead >= 0xE0 && lead <= 0xEF) { len = 3; code = lead & 0x0F; }
+            else if (lead >= 0xF0 && lead <= 0xF4) { len = 4; code = lead & 0x07; }
+
+            // The second byte range excludes overlong forms, surrogates and code points above U+10FFFF
+            unsigned char lo = (lead == 0xE0 ? 0xA0 : lead == 0xF0 ? 0x90 : 0x80);
+            unsigned char hi = (lead == 0xED ? 0x9F : lead == 0xF4 ? 0x8F : 0xBF);
+            unsigned got = 1;
+            for (; got < len && i + got < n && src[i + got] >= lo && src[i + got] <= hi; got++)
+            {
+                code = (code << 6) | (src[i + got] & 0x3F);
+                lo = 0x80;
+                hi = 0xBF;
+            }
+
+            if (got < len && i + got == n && !last)
+            {
+                if (used) *used = i;
+                return k;
+            }
+
+            wbuff[k] = (got == len ? (wchar_t)code : WUTF8_BAD);
+            i += got;
+        }
+    }
+
+    if (used) *used = i;
+    return k;
+}
+
+/** @brief Read-only view of a whole UTF-8 file mapped into memory.
+ *
+ * The bytes are never copied nor changed: passes over the text decode them as they go with
+ * wutf8_decode, a block at a time, and all of them, in any number of threads, read the same pages of the
+ * page cache.
+ */
+
+struct wCorpus
+{
+    const unsigned char* bytes;     //!< The mapped file, NULL if it is empty.
+    size_t               size;      //!< Size of the file in bytes.
+};
+
+/** @brief Span of bytes of a wCorpus. */
+
+struct wSpan
+{
+    size_t off;                     //!< First byte.
+    size_t len;                     //!< Number of bytes.
+};
+
+/** @brief Maps the regular file @b in_fname into @b corpus for reading, sequentially by hint.
+ *
+ * @return 0 if fails, including for files which can not be mapped such as pipes, 1 otherwise.
+ */
+
+int wCorpus_open (struct wCorpus* corpus, const char* in_fname)
 {
-    // TODO: Handle files bigger than 4GB (size > unsigned long long int)
-    FILE* infile = fopen (in_fname, "r");
-    if (!infile) return NULL;
+    assert (corpus && in_fname);
+
+    corpus -> bytes = NULL;
+    corpus -> size  = 0;
+    int infd = open (in_fname, O_RDONLY);
+    if (infd < 0) return 0;
 
     struct stat infile_st;
-    stat (in_fname, &infile_st);
-    uintmax_t infile_size = infile_st.st_size;
+    int ok = fstat (infd, &infile_st) == 0 && S_ISREG (infile_st.st_mode) &&
+             (uintmax_t)infile_st.st_size < SIZE_MAX / sizeof (wchar_t);
+    if (ok && infile_st.st_size)
+    {
+        void* bytes = mmap (NULL, infile_st.st_size, PROT_READ, MAP_SHARED, infd, 0);
+        ok = bytes != MAP_FAILED;
+        if (ok)
+        {
+            madvise (bytes, infile_st.st_size, MADV_SEQUENTIAL);
+            corpus -> bytes = bytes;
+            corpus -> size  = infile_st.st_size;
+        }
+    }
+    close (infd);
+    return ok;
+}
+
+/** @brief Unmaps the file of @b corpus and leaves it empty. */
+
+void wCorpus_close (struct wCorpus* corpus)
+{
+    if (corpus -> bytes) munmap ((void*)corpus -> bytes, corpus -> size);
+    corpus -> bytes = NULL;
+    corpus -> size  = 0;
+}
+
+/** @brief Finds the lines of @b corpus without changing it.
+ *
+ * Lines are the runs of bytes between newlines, which they do not include; empty ones are skipped, as in
+ * wsplitlines. Newlines are counted first, so the array is allocated once, to fit.
+ *
+ * @return NULL if fails or there are no lines, array of their spans otherwise, their number is stored in
+ * @b nlines.
+ */
 
-    if (!wbuffer)
+struct wSpan* wCorpus_lines (const struct wCorpus* corpus, size_t* nlines)
+{
+    assert (corpus && nlines);
+
+    const unsigned char* bytes = corpus -> bytes;
+    const unsigned char* end   = bytes + corpus -> size;
+    size_t n = 0;
+    for (const unsigned char* pos = bytes; pos < end; n++)
     {
-        wbuffer = calloc (infile_size, sizeof (wchar_t));
+        const unsigned char* nl = memchr (pos, '\n', end - pos);
+        pos = nl ? nl + 1 : end;
     }
+
+    *nlines = 0;
+    struct wSpan* lines = n ? malloc (n * sizeof (struct wSpan)) : NULL;
+    for (const unsigned char* pos = bytes; lines && pos < end; )
+    {
+        const unsigned char* nl = memchr (pos, '\n', end - pos);
+        if (!nl) nl = end;
+        if (nl > pos)
+        {
+            lines[*nlines].off = pos - bytes;
+            lines[*nlines].len = nl - pos;
+            (*nlines)++;
+        }
+        pos = nl + 1;
+    }
+    if (lines && !*nlines)
+    {
+        free (lines);
+        lines = NULL;
+    }
+    return lines;
+}
+
+/** @brief Loads the whole UTF-8 file into a NUL-terminated buffer of code points.
+ *
+ * The file is mapped as a wCorpus and decoded at once with wutf8_decode, regardless of the locale.
+ * @b wbuffer is reallocated to fit, so it may be NULL.
+ *
+ * @return NULL if fails, pointer to the buffer otherwise.
+ */
+
+wchar_t* wloadfile (const char* in_fname, wchar_t* wbuffer) 
+{
+    struct wCorpus corpus;
+    if (!wCorpus_open (&corpus, in_fname)) return NULL;
+
+    wchar_t* wnew = realloc (wbuffer, (corpus.size + 1) * sizeof (wchar_t));
+    if (wnew)
+        wnew[wutf8_decode (wnew, corpus.bytes, corpus.size, NULL, 1)] = L'\0';
     else
+        free (wbuffer);
+
+    wCorpus_close (&corpus);
+    return wnew;
+}
+
+#define WOUTBUF_SIZE (1 << 16)      //!< Default size of the buffer of wOutbuf_fd.
+
+/** @brief Buffer collecting code points as UTF-8 until they are written in big blocks.
+ *
+ * Flushes to a file descriptor with write(), or fills memory given by the caller: once that is full, the
+ * rest of the output is dropped and @c full is set. Code points are never split between blocks.
+ */
+
+struct wOutbuf
+{
+    int            fd;          //!< Descriptor to flush to, -1 for the caller's memory.
+    unsigned char* buf;         //!< The buffer.
+    size_t         cap;         //!< Size of the buffer.
+    size_t         len;         //!< Number of bytes in the buffer.
+    size_t         total;       //!< Number of bytes put so far, flushed or not.
+    int            owned;       //!< Whether the buffer was allocated by wOutbuf_fd.
+    int            full;        //!< Whether output was dropped for lack of room.
+    int            failed;      //!< Whether a write has failed.
+};
+
+/** @brief Constructor of buffers flushing to @b fd, @b cap bytes large or WOUTBUF_SIZE if 0.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wOutbuf_fd (struct wOutbuf* ob, int fd, size_t cap)
+{
+    assert (ob);
+
+    memset (ob, 0, sizeof (struct wOutbuf));
+    ob -> fd    = fd;
+    ob -> cap   = (cap >= 4 ? cap : WOUTBUF_SIZE);
+    ob -> buf   = malloc (ob -> cap);
+    ob -> owned = 1;
+    return ob -> buf != NULL;
+}
+
+/** @brief Constructor of buffers filling @b cap bytes of the caller's memory at @b mem. */
+
+void wOutbuf_mem (struct wOutbuf* ob, void* mem, size_t cap)
+{
+    assert (ob && (mem || !cap));
+
+    memset (ob, 0, sizeof (struct wOutbuf));
+    ob -> fd  = -1;
+    ob -> buf = mem;
+    ob -> cap = cap;
+}
+
+/** @brief Writes all of @b n bytes at @b data to @b fd, retrying short and interrupted writes.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wwriteall (int fd, const void* data, size_t n)
+{
+    const unsigned char* bytes = data;
+    while (n)
     {
-        wbuffer = realloc (wbuffer, infile_size * sizeof (wchar_t) + 16);
-        wbuffer[infile_size + 1] = L'\0'; 
+        ssize_t got = write (fd, bytes, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0;
+        bytes += got;
+        n     -= got;
     }
+    return 1;
+}
 
-    fgetnwc (wbuffer, 0, infile);
-    
-    fclose (infile);
+/** @brief Writes out the contents of the buffer, if it flushes to a descriptor.
+ *
+ * @return 0 if a write has failed, now or before, 1 otherwise.
+ */
+
+int wOutbuf_flush (struct wOutbuf* ob)
+{
+    assert (ob);
+
+    if (ob -> fd < 0 || ob -> failed) return !ob -> failed;
+
+    if (!wwriteall (ob -> fd, ob -> buf, ob -> len)) ob -> failed = 1;
+    ob -> len = 0;
+    return !ob -> failed;
+}
+
+/** @brief Service function making room for one more code point. Returns 0 if there is none. */
+
+int wOutbuf_room (struct wOutbuf* ob)
+{
+    if (ob -> fd >= 0) return wOutbuf_flush (ob);
+
+    ob -> full = 1;
+    return 0;
+}
+
+/** @brief Puts the code point @b wch into the buffer as UTF-8, WUTF8_BAD if it is not a valid one. */
+
+static inline void wOutbuf_put (struct wOutbuf* ob, wchar_t wch)
+{
+    uint32_t code = (uint32_t)wch;
+    if (code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) code = WUTF8_BAD;
+    unsigned n = (code < 0x80 ? 1 : code < 0x800 ? 2 : code < 0x10000 ? 3 : 4);
+
+    if ((ob -> cap - ob -> len < n || ob -> full) && !wOutbuf_room (ob)) return;
+
+    unsigned char* out = ob -> buf + ob -> len;
+    if (n == 1) out[0] = code;
+    else
+    {
+        for (unsigned j = n - 1; j > 0; j--, code >>= 6)
+            out[j] = 0x80 | (code & 0x3F);
+        out[0] = ((0xFF00 >> n) & 0xFF) | code;
+    }
+    ob -> len   += n;
+    ob -> total += n;
+}
+
+/** @brief Flushes the buffer and frees it if it was allocated by wOutbuf_fd. Leaves the descriptor open.
+ *
+ * @return 0 if any write has failed, 1 otherwise.
+ */
 
-    return wbuffer;
+int wOutbuf_close (struct wOutbuf* ob)
+{
+    assert (ob);
+
+    int ok = wOutbuf_flush (ob);
+    if (ob -> owned) free (ob -> buf);
+    ob -> buf = NULL;
+    ob -> cap = ob -> len = 0;
+    return ok;
 }
 
 wchar_t** wsplitlines_exp (wchar_t* wbuffer, int* linecount)
@@ -158,3 +509,186 @@ int alpha_strcmp_r (const void* vstr1, const void* vstr2, void* vdir)
     return 0;
 }
 
+/** @brief Service function folding a symbol for sort keys: lower case for letters, 0 for the rest. */
+
+static inline wchar_t wsortfold (wchar_t wch)
+{
+    if ((uint32_t)wch < 0x80)
+        return (wch >= L'A' && wch <= L'Z') ? wch + (L'a' - L'A') : (wch >= L'a' && wch <= L'z') ? wch : 0;
+    return iswalpha (wch) ? towlower (wch) : 0;
+}
+
+/** @brief Sort key of a line, see wsortlines. */
+
+struct wSortkey
+{
+    const wchar_t* key;             //!< Folded letters of the line, in the order of comparison.
+    size_t         len;             //!< Number of symbols of the key.
+    size_t         idx;             //!< Index of the line.
+};
+
+/** @brief Service function returning symbol @b d of a sort key, 0 past its end, which no key holds. */
+
+static inline wchar_t wsortkey_at (const struct wSortkey* k, size_t d)
+{
+    return d < k -> len ? k -> key[d] : 0;
+}
+
+/** @brief Service function comparing sort keys from symbol @b d on, then indices of their lines. */
+
+static inline int wsortkey_cmp (const struct wSortkey* a, const struct wSortkey* b, size_t d)
+{
+    size_t len = a -> len < b -> len ? a -> len : b -> len;
+    for (; d < len; d++)
+        if (a -> key[d] != b -> key[d]) return a -> key[d] < b -> key[d] ? -1 : 1;
+    if (a -> len != b -> len) return a -> len < b -> len ? -1 : 1;
+    return (a -> idx > b -> idx) - (a -> idx < b -> idx);
+}
+
+/** @brief Service function comparing sort keys by the indices of their lines for qsort. */
+
+int wsortkey_idxcmp (const void* a, const void* b)
+{
+    size_t ia = ((const struct wSortkey*)a) -> idx;
+    size_t ib = ((const struct wSortkey*)b) -> idx;
+    return (ia > ib) - (ia < ib);
+}
+
+#define WSORT_SMALL 16  //!< Partitions up to this size are sorted by insertion in wsortlines.
+
+/** @brief Sorts @b n lines in the order of alpha_strcmp_r, reading them once.
+ *
+ * The key of every line, its letters folded to lower case and reversed for DFROMEND to sort rhymes, is
+ * built once, so each symbol is classified once instead of at each comparison. Keys are then sorted by
+ * multikey quicksort, a radix sort on symbols which partitions on a single symbol at a time and never
+ * compares prefixes known to be equal, with an explicit stack and insertion sort for small partitions.
+ * Unlike alpha_strcmp_r, a key which is a prefix of another comes first, and lines of equal keys keep
+ * their order, so the order is total and does not depend on the sorting algorithm.
+ *
+ * @return NULL if fails, otherwise an array of @b n indices of the lines in sorted order, to be freed by
+ * the caller.
+ */
+
+size_t* wsortlines (wchar_t* const* lines, size_t n, char dir)
+{
+    assert (lines || !n);
+
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) total += wcslen (lines[i]);
+
+    struct wSortkey* keys  = malloc ((n + 1) * sizeof (struct wSortkey));
+    wchar_t*         folds = malloc ((total + 1) * sizeof (wchar_t));
+    size_t*          perm  = malloc ((n + 1) * sizeof (size_t));
+    size_t           cap   = 64;
+    size_t*          stack = malloc (3 * cap * sizeof (size_t));
+    int ok = keys && folds && perm && stack;
+
+    wchar_t* pos = folds;
+    for (size_t i = 0; ok && i < n; i++)
+    {
+        keys[i].key = pos;
+        keys[i].idx = i;
+        for (const wchar_t* wch = lines[i]; *wch; wch++)
+            if ((*pos = wsortfold (*wch))) pos++;
+        keys[i].len = pos - keys[i].key;
+        if (dir == DFROMEND)
+            for (wchar_t *lo = (wchar_t*)keys[i].key, *hi = pos - 1; lo < hi; lo++, hi--)
+            {
+                wchar_t wch = *lo;
+                *lo = *hi;
+                *hi = wch;
+            }
+    }
+
+    // Partitions to sort: first key, number of keys, symbols known equal
+    size_t depth = 0;
+    if (ok)
+    {
+        stack[0] = 0;
+        stack[1] = n;
+        stack[2] = 0;
+        depth = 1;
+    }
+    while (ok && depth)
+    {
+        depth--;
+        struct wSortkey* part = keys + stack[3 * depth];
+        size_t m = stack[3 * depth + 1];
+        size_t d = stack[3 * depth + 2];
+
+        if (m <= WSORT_SMALL)
+        {
+            for (size_t i = 1; i < m; i++)
+            {
+                struct wSortkey k = part[i];
+                size_t j = i;
+                for (; j && wsortkey_cmp (&k, part + j - 1, d) < 0; j--) part[j] = part[j - 1];
+                part[j] = k;
+            }
+            continue;
+        }
+
+        // Median of three symbols, then partitioned into less, equal and greater than it
+        wchar_t a = wsortkey_at (part, d);
+        wchar_t b = wsortkey_at (part + m / 2, d);
+        wchar_t c = wsortkey_at (part + m - 1, d);
+        wchar_t pivot = (a < b) ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        size_t lt = 0;
+        size_t gt = m;
+        for (size_t i = 0; i < gt; )
+        {
+            wchar_t wch = wsortkey_at (part + i, d);
+            struct wSortkey k = part[i];
+            if (wch < pivot)
+            {
+                part[i++] = part[lt];
+                part[lt++] = k;
+            }
+            else if (wch > pivot)
+            {
+                part[i] = part[--gt];
+                part[gt] = k;
+            }
+            else i++;
+        }
+
+        if (depth + 3 > cap)
+        {
+            size_t* grown = realloc (stack, 6 * cap * sizeof (size_t));
+            ok = grown != NULL;
+            if (!ok) break;
+            stack = grown;
+            cap *= 2;
+        }
+        size_t parts[3][3] = { { 0, lt, d }, { lt, gt - lt, d + 1 }, { gt, m - gt, d } };
+        for (unsigned p = 0; p < 3; p++)
+        {
+            if (parts[p][1] < 2) continue;
+            // Keys equal to their ends only need their lines back in order
+            if (p == 1 && !pivot)
+            {
+                qsort (part + lt, gt - lt, sizeof (struct wSortkey), wsortkey_idxcmp);
+                continue;
+            }
+            stack[3 * depth]     = part - keys + parts[p][0];
+            stack[3 * depth + 1] = parts[p][1];
+            stack[3 * depth + 2] = parts[p][2];
+            depth++;
+        }
+    }
+
+    for (size_t i = 0; ok && i < n; i++) perm[i] = keys[i].idx;
+
+    free (keys);
+    free (folds);
+    free (stack);
+    if (!ok)
+    {
+        free (perm);
+        return NULL;
+    }
+    return perm;
+}
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file wstats.h
+ * @brief Counters of hot paths and wall time of phases of a run
+ *
+ * Counters are compiled in with WSTATS set to 1, and compile to nothing otherwise, so default builds pay
+ * nothing for them: WSTATS_ADD does not even evaluate its argument. They count nodes and bytes spawned
+ * by tries, steps of looking up children with wTrie_child, hits and misses of wTrie_findword, and steps
+ * of generation which back off to a shorter context than the one they came from or end a document.
+ *
+ * Every thread counts into counters of its own, which it adds to the totals with WSTATS_FLUSH once it is
+ * done, so counting takes no locks and shares no cache lines. Threads of the library flush before they
+ * exit; the totals are read with wStats_get, which flushes the calling thread first.
+ *
+ * Wall time of phases of a run (loading, training, freezing...) is a handful of clock readings per run,
+ * so it is kept in every build, see wStats_lap. wStats_json writes all of it as a JSON object.
+ */
+
+#ifndef _WSTATS_H_
+#define _WSTATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WSTATS
+#define WSTATS 0
+#endif
+
+#if WSTATS
+#include <pthread.h>
+#endif
+
+/** @brief Phases of a run timed with wStats_lap. */
+
+enum wStats_phase
+{
+    WSTATS_LOAD,        //!< Loading count models and models.
+    WSTATS_ALPHABET,    //!< Numbering symbols of the text, see wMarkov_alphabet.
+    WSTATS_TRAIN,       //!< Counting transitions.
+    WSTATS_PRUNE,       //!< Pruning, see wMarkov_prune.
+    WSTATS_FREEZE,      //!< Turning counts into a frozen model, see wFrozen_freeze.
+    WSTATS_SAVE,        //!< Saving count models and models.
+    WSTATS_GENERATE,    //!< Generating text.
+    WSTATS_PHASES       //!< Number of phases.
+};
+
+static const char* const wStats_names[WSTATS_PHASES] =
+    { "load", "alphabet", "train", "prune", "freeze", "save", "generate" };
+
+struct wStats
+{
+    uint64_t nodes;         //!< Nodes spawned.
+    uint64_t node_bytes;    //!< Bytes of nodes spawned, their meta included.
+    uint64_t kid_bytes;     //!< Bytes taken for children arrays and tables.
+    uint64_t child_calls;   //!< Calls of wTrie_child.
+    uint64_t child_tables;  //!< Calls of wTrie_child answered by a direct-indexed table.
+    uint64_t child_steps;   //!< Symbols compared by the other calls, scanning or in binary search.
+    uint64_t find_hits;     //!< Words found by wTrie_findword.
+    uint64_t find_misses;   //!< Words not found by wTrie_findword.
+    uint64_t gen_steps;     //!< Symbols generated by wFrozen_walk.
+    uint64_t gen_backoffs;  //!< Steps leading to a shorter context than the one they came from, plus one.
+    uint64_t gen_ends;      //!< Steps ending a document and going back to the start state.
+    double   phase[WSTATS_PHASES]; //!< Wall time of each phase, in seconds.
+};
+
+struct wStats wStats_total;                 //!< Totals of all threads flushed so far.
+
+#if WSTATS
+_Thread_local struct wStats wStats_local;   //!< Counters of the calling thread since its last flush.
+pthread_mutex_t wStats_lock = PTHREAD_MUTEX_INITIALIZER; //!< Guards wStats_total.
+
+/** @brief Adds the counters of the calling thread to the totals and clears them. */
+
+void wStats_flush (void)
+{
+    pthread_mutex_lock (&wStats_lock);
+    uint64_t* total = &wStats_total.nodes;
+    uint64_t* local = &wStats_local.nodes;
+    for (size_t i = 0; &local[i] <= &wStats_local.gen_ends; i++) total[i] += local[i];
+    pthread_mutex_unlock (&wStats_lock);
+    memset (&wStats_local, 0, sizeof (struct wStats));
+}
+
+#define WSTATS_ADD(field, n) (wStats_local.field += (n))   //!< Adds @b n to a counter of the calling thread.
+#define WSTATS_FLUSH()       wStats_flush ()                //!< Adds counters of the calling thread to totals.
+#else
+#define WSTATS_ADD(field, n) ((void)0)
+#define WSTATS_FLUSH()       ((void)0)
+#endif
+
+/** @brief Returns the time of a monotonic clock in seconds. */
+
+double wStats_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** @brief Adds the time since @b since, a reading of wStats_now, to the wall time of @b phase.
+ *
+ * Phases are timed by the main thread, one at a time.
+ *
+ * @return The time now, for the next phase to start from.
+ */
+
+double wStats_lap (enum wStats_phase phase, double since)
+{
+    double now = wStats_now ();
+    wStats_total.phase[phase] += now - since;
+    return now;
+}
+
+/** @brief Returns the totals of all counters, flushing those of the calling thread first. */
+
+struct wStats wStats_get (void)
+{
+    WSTATS_FLUSH ();
+    return wStats_total;
+}
+
+/** @brief Writes the totals as a JSON object to @b out, with counters set to null if they are compiled out.
+ *
+ * @return 0 if fails to write, 1 otherwise.
+ */
+
+int wStats_json (FILE* out)
+{
+    struct wStats st = wStats_get ();
+    uint64_t lookups = st.child_calls - st.child_tables;
+    uint64_t finds = st.find_hits + st.find_misses;
+
+    fprintf (out, "{\n  \"counters\": ");
+    if (WSTATS)
+    {
+        fprintf (out, "{\n");
+        fprintf (out, "    \"nodes\": %llu,\n", (unsigned long long)st.nodes);
+        fprintf (out, "    \"node_bytes\": %llu,\n", (unsigned long long)st.node_bytes);
+        fprintf (out, "    \"kid_bytes\": %llu,\n", (unsigned long long)st.kid_bytes);
+        fprintf (out, "    \"child_calls\": %llu,\n", (unsigned long long)st.child_calls);
+        fprintf (out, "    \"child_tables\": %llu,\n", (unsigned long long)st.child_tables);
+        fprintf (out, "    \"child_scan_avg\": %.3f,\n", lookups ? (double)st.child_steps / lookups : 0.0);
+        fprintf (out, "    \"find_hits\": %llu,\n", (unsigned long long)st.find_hits);
+        fprintf (out, "    \"find_misses\": %llu,\n", (unsigned long long)st.find_misses);
+        fprintf (out, "    \"find_hit_rate\": %.6f,\n", finds ? (double)st.find_hits / finds : 0.0);
+        fprintf (out, "    \"gen_steps\": %llu,\n", (unsigned long long)st.gen_steps);
+        fprintf (out, "    \"gen_backoffs\": %llu,\n", (unsigned long long)st.gen_backoffs);
+        fprintf (out, "    \"gen_backoff_rate\": %.6f,\n", st.gen_steps ? (double)st.gen_backoffs / st.gen_steps : 0.0);
+        fprintf (out, "    \"gen_ends\": %llu\n  }", (unsigned long long)st.gen_ends);
+    }
+    else fprintf (out, "null");
+
+    fprintf (out, ",\n  \"phases\": {\n");
+    for (unsigned p = 0; p < WSTATS_PHASES; p++)
+        fprintf (out, "    \"%s\": %.6f%s\n", wStats_names[p], st.phase[p], p + 1 < WSTATS_PHASES ? "," : "");
+    return fprintf (out, "  }\n}\n") > 0 && !ferror (out);
+}
+
+#endif
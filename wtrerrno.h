@@ -11,6 +11,23 @@
 #define E_WTRIE_NULLPOINTER 347
 #define E_WTRIE_NOSUCHWORD  348
 
+#define E_WFROZEN_NOMEM     350
+#define E_WFROZEN_TOOBIG    351
+#define E_WFROZEN_IO        352
+#define E_WFROZEN_BADFILE   353
+#define E_WFROZEN_VERSION   354
+
+#define E_WMARKOV_IO        370
+#define E_WMARKOV_BADFILE   371
+#define E_WMARKOV_VERSION   372
+#define E_WMARKOV_LINES     373
+
+#define E_WHASH_NOMEM       380
+#define E_WHASH_IO          381
+
+#define E_WALPHA_NOMEM      390
+#define E_WALPHA_BADCODE    391
+
 #define W_WTRIE_METANOTSET  360
 
 #define I_WTRIE_NOSUCHWORD  388
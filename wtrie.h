@@ -41,10 +41,13 @@
 
 #include <wchar.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
 #include <string.h>
 #include "wtrerrno.h"
 #include "precond.h"
+#include "wstats.h"
 
 /**
  * @brief The wTrie data structure.
@@ -58,10 +61,15 @@
  * subtree or branch.
  *
  * Subnodes of a node are called @b children of that node, the node then is called @b parent of those
- * subnodes. Children of the same node are called @siblings. For the reasons of more effective memory
- * management, each node has only two pointer members: one to a child and one to a sibling. That way,
- * only the first child is linked directly to its parent, all the other children form a singly linked
- * list by pointing to the next sibling. Pointers to parents are not supported.
+ * subnodes. Children of the same node are called @siblings. Children are kept in an array sorted by
+ * their symbols, which adapts to the number of children: a single child is linked directly from the
+ * parent without any array, up to WTRIE_SCAN children are scanned linearly, more are searched
+ * binarily, and nodes with many children from a narrow range of symbols also get a direct-indexed
+ * table (see wTrie_table). Symbols of children are stored in the array next to the pointers, so a
+ * lookup never touches children it does not return. Use wTrie_kid to iterate over children in order of
+ * their symbols. Pointers to parents are not supported.
+ *
+ * Nodes are either allocated one by one with calloc, or taken from a wTrie_pool, see wTrie_spawn_from.
  *
  * @warning Developers should consider modifying the structure and adding new fields if necessary 
  * rather than using void* meta extensively.
@@ -71,29 +79,350 @@
 struct wTrie
 {
     wchar_t       wc;       //!< The wide charater of the node.
-    struct wTrie* sibling;  //!< The next sibling. Shall be NULL if the node is the last child.
-    struct wTrie* child;    //!< The first child. Shall be NULL if the node has no children.
     bool          term;     //!< The flag showing if the node is terminating. 
+    bool          pooled;   //!< The flag showing if the node (and its meta) belongs to a wTrie_pool.
+    bool          poolkids; //!< The flag showing if the children array and table belong to a wTrie_pool.
+    unsigned      nkids;    //!< Number of children.
+    unsigned      capkids;  //!< Capacity of the children array, 0 if there is no array.
+    union
+    {
+        struct wTrie*  one;  //!< The only child if capkids is 0. Shall be NULL if the node has no children.
+        struct wTrie** many; //!< capkids pointers to children sorted by symbol, followed by capkids
+                             //!< symbols of those children, see wTrie_keys.
+    } kids;
+    struct wTrie_table* table; //!< Direct-indexed children for dense nodes, NULL otherwise.
+    unsigned long count;    //!< Number of times the node was met, such as a Markov transition count.
     void*         meta;     //!< Pointer to any value, just in case.
+    struct wTrie* suffix;   //!< Suffix link: the node of the same word without its first symbol. Maintained
+                            //!< only by wTrie_slchild, NULL otherwise.
+};
+
+/** @brief Direct-indexed table of children of a dense node.
+ *
+ * Holds the child with symbol @c wc in @c slot[wc - lo], or NULL. Kept alongside the sorted children
+ * array for nodes with at least WTRIE_DENSE_MIN children when their symbols span no more than
+ * WTRIE_DENSE_RATIO times the number of children.
+ */
+
+struct wTrie_table
+{
+    wchar_t       lo;       //!< Symbol of slot 0.
+    unsigned      size;     //!< Number of slots.
+    struct wTrie* slot[];   //!< Children by symbol.
 };
 
-/** @brief Recursive consistency check.
+#define WTRIE_SCAN        8  //!< Children arrays up to this size are scanned linearly.
+#define WTRIE_DENSE_MIN   32 //!< Minimal number of children of a node to get a direct-indexed table.
+#define WTRIE_DENSE_RATIO 4  //!< Maximal ratio of table size to the number of children.
+
+/** @brief Arena of wTrie nodes.
+ *
+ * Pool hands out memory from big blocks with a bump pointer, so nodes spawned one after another lie
+ * next to each other in memory and cost no malloc call each. Memory is never returned to the system
+ * piece by piece: discarding a pooled node only forgets it, and wTrie_pool_free releases the whole
+ * tree at once, in O(number of blocks). Children arrays, which are outgrown and replaced, are taken
+ * with wTrie_pool_get and returned with wTrie_pool_put for reuse.
+ *
+ * If @c WTRIE_POISON is defined, discarded nodes and freed blocks are filled with @c C3 ("poison")
+ * bytes, which helps catching use after free at the cost of touching every byte once more.
+ */
+
+struct wTrie_block
+{
+    struct wTrie_block* prev;   //!< The block allocated before this one.
+    size_t              size;   //!< Size of the block including this header.
+};
+
+struct wTrie_pool
+{
+    struct wTrie_block* blocks; //!< The last allocated block.
+    char*               next;   //!< First free byte of the last block.
+    size_t              left;   //!< Number of free bytes in the last block.
+    size_t              block_sz; //!< Size of blocks to allocate.
+    size_t              nbytes; //!< Total number of bytes allocated from the system.
+    size_t              nnodes; //!< Number of nodes taken from the pool.
+    void*               freed[64]; //!< Lists of returned pieces by binary logarithm of their size.
+};
+
+#define WTRIE_POOL_BLOCK (1 << 20)  //!< Default size of pool blocks.
+#define WTRIE_POOL_ALIGN 16         //!< Alignment of memory handed out by pools.
+
+/** @brief Constructor of pools. Should ALWAYS be called after creating a wTrie_pool.
+ *
+ * @b block_sz of zero selects WTRIE_POOL_BLOCK. No memory is allocated until the first request.
+ *
+ * @return @b 0 if supplied with a NULL @c pool pointer, 1 otherwise.
+ */
+
+int wTrie_pool_init (struct wTrie_pool* pool, size_t block_sz)
+{
+    _PRECONDITION_CHEAP (pool, E_WTRIE_NULLPOINTER, return 0);
+
+    memset (pool, 0, sizeof (struct wTrie_pool));
+    pool -> block_sz = block_sz ? block_sz : WTRIE_POOL_BLOCK;
+    return 1;
+}
+
+/** @brief Takes @b size bytes of uninitialized memory from the pool.
+ *
+ * Requests bigger than a block get a block of their own.
+ *
+ * @return NULL if fails, pointer to memory aligned to WTRIE_POOL_ALIGN otherwise.
+ */
+
+void* wTrie_pool_alloc (struct wTrie_pool* pool, size_t size)
+{
+    _PRECONDITION_CHEAP (pool, E_WTRIE_NULLPOINTER, return NULL);
+
+    size = (size + WTRIE_POOL_ALIGN - 1) & ~(size_t)(WTRIE_POOL_ALIGN - 1);
+    if (size > pool -> left)
+    {
+        size_t bsize = WTRIE_POOL_ALIGN + (size > pool -> block_sz ? size : pool -> block_sz);
+        struct wTrie_block* block = malloc (bsize);
+        _PRECONDITION (block, E_WTRIE_SPAWNFAILED, return NULL);
+
+        block -> prev = pool -> blocks;
+        block -> size = bsize;
+        pool -> blocks = block;
+        pool -> next   = (char*)block + WTRIE_POOL_ALIGN;
+        pool -> left   = bsize - WTRIE_POOL_ALIGN;
+        pool -> nbytes += bsize;
+    }
+
+    void* mem = pool -> next;
+    pool -> next += size;
+    pool -> left -= size;
+    return mem;
+}
+
+/** @brief Service function returning the binary logarithm of the smallest power of 2 not less than size. */
+
+unsigned wTrie_pool_class (size_t size)
+{
+    unsigned class = 4;
+    while (((size_t)1 << class) < size) class++;
+    return class;
+}
+
+/** @brief Takes a piece of at least @b size bytes from the pool, reusing a returned one if possible.
+ *
+ * Pieces are rounded up to a power of 2, see wTrie_pool_put.
+ *
+ * @return NULL if fails, pointer to uninitialized memory otherwise.
+ */
+
+void* wTrie_pool_get (struct wTrie_pool* pool, size_t size)
+{
+    _PRECONDITION_CHEAP (pool, E_WTRIE_NULLPOINTER, return NULL);
+
+    unsigned class = wTrie_pool_class (size);
+    void* mem = pool -> freed[class];
+    if (mem)
+    {
+        pool -> freed[class] = *(void**)mem;
+        return mem;
+    }
+    return wTrie_pool_alloc (pool, (size_t)1 << class);
+}
+
+/** @brief Returns a piece taken with wTrie_pool_get of the same @b size to the pool. */
+
+void wTrie_pool_put (struct wTrie_pool* pool, void* mem, size_t size)
+{
+    _PRECONDITION_CHEAP ((pool && mem), E_WTRIE_NULLPOINTER, return);
+
+    unsigned class = wTrie_pool_class (size);
+#ifdef WTRIE_POISON
+    memset (mem, 0xC3, (size_t)1 << class);
+#endif
+    *(void**)mem = pool -> freed[class];
+    pool -> freed[class] = mem;
+}
+
+/** @brief Releases all memory of the pool at once, including every node taken from it.
+ *
+ * The pool is left initialized and empty and can be reused.
+ */
+
+void wTrie_pool_free (struct wTrie_pool* pool)
+{
+    _PRECONDITION_CHEAP (pool, E_WTRIE_NULLPOINTER, return);
+
+    struct wTrie_block* block = pool -> blocks;
+    while (block)
+    {
+        struct wTrie_block* prev = block -> prev;
+#ifdef WTRIE_POISON
+        memset (block, 0xC3, block -> size);
+#endif
+        free (block);
+        block = prev;
+    }
+    wTrie_pool_init (pool, pool -> block_sz);
+}
+
+/** @brief Moves all memory of pool @b src into pool @b dst, so that nodes taken from either are released
+ * together by wTrie_pool_free of @b dst. @b src is left initialized and empty.
+ */
+
+void wTrie_pool_absorb (struct wTrie_pool* dst, struct wTrie_pool* src)
+{
+    _PRECONDITION_CHEAP ((dst && src), E_WTRIE_NULLPOINTER, return);
+
+    if (!src -> blocks)
+    {
+        wTrie_pool_init (src, src -> block_sz);
+        return;
+    }
+
+    // Blocks of src go behind the last block of dst, which keeps serving new requests
+    struct wTrie_block* oldest = src -> blocks;
+    while (oldest -> prev) oldest = oldest -> prev;
+    if (dst -> blocks)
+    {
+        oldest -> prev = dst -> blocks -> prev;
+        dst -> blocks -> prev = src -> blocks;
+    }
+    else
+    {
+        dst -> blocks = src -> blocks;
+        dst -> next   = src -> next;
+        dst -> left   = src -> left;
+    }
+
+    for (unsigned class = 0; class < 64; class++)
+    {
+        void** tail = &dst -> freed[class];
+        while (*tail) tail = (void**)*tail;
+        *tail = src -> freed[class];
+    }
+
+    dst -> nbytes += src -> nbytes;
+    dst -> nnodes += src -> nnodes;
+    wTrie_pool_init (src, src -> block_sz);
+}
+
+/** @brief Returns the array of symbols of children of a node, NULL if the node has no children array. */
+
+wchar_t* wTrie_keys (struct wTrie* wtr)
+{
+    return wtr -> capkids ? (wchar_t*)(wtr -> kids.many + wtr -> capkids) : NULL;
+}
+
+/** @brief Returns the i-th child of a node in order of their symbols. @b i shall be less than nkids. */
+
+struct wTrie* wTrie_kid (struct wTrie* wtr, unsigned i)
+{
+    return wtr -> capkids ? wtr -> kids.many[i] : wtr -> kids.one;
+}
+
+/** @brief Returns the symbol of the i-th child of a node. @b i shall be less than nkids. */
+
+wchar_t wTrie_kidwc (struct wTrie* wtr, unsigned i)
+{
+    return wtr -> capkids ? wTrie_keys (wtr)[i] : wtr -> kids.one -> wc;
+}
+
+/** @brief Service function finding the position of a symbol among children of a node.
+ *
+ * @return Number of children with symbols less than @b wch.
+ */
+
+unsigned wTrie_kidpos (struct wTrie* wtr, wchar_t wch)
+{
+    if (!wtr -> capkids) return (wtr -> nkids && wtr -> kids.one -> wc < wch) ? 1 : 0;
+
+    const wchar_t* keys = wTrie_keys (wtr);
+    unsigned lo = 0;
+    unsigned hi = wtr -> nkids;
+    if (hi <= WTRIE_SCAN)
+    {
+        while (lo < hi && keys[lo] < wch) lo++;
+        WSTATS_ADD (child_steps, lo + (lo < hi));
+        return lo;
+    }
+    while (lo < hi)
+    {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (keys[mid] < wch) lo = mid + 1;
+        else                 hi = mid;
+        WSTATS_ADD (child_steps, 1);
+    }
+    return lo;
+}
+
+/** @brief Service function pushing a node onto a stack of nodes, growing the stack as needed.
+ *
+ * @return 0 if fails to grow the stack, 1 otherwise.
+ */
+
+int wTrie_push (struct wTrie*** stack, size_t* n, size_t* cap, struct wTrie* wtr)
+{
+    if (*n == *cap)
+    {
+        size_t size = *cap ? *cap * 2 : 64;
+        struct wTrie** grown = realloc (*stack, size * sizeof (struct wTrie*));
+        if (!grown) return 0;
+        *stack = grown;
+        *cap   = size;
+    }
+    (*stack)[(*n)++] = wtr;
+    return 1;
+}
+
+/** @brief Consistency check of a single node.
+ *
+ * Checks that children of the node are sorted by symbol and agree with the symbols stored in the node
+ * and with its direct-indexed table, if any. Children themselves are not checked.
  *
  * @return @b 1 if check succeeds, @b 0 otherwise.
+ */
+
+int wTrie_nodeOK (struct wTrie* wtr)
+{
+    if (!wtr) return 0;
+    if (!wtr -> capkids && (wtr -> nkids > 1 || (wtr -> nkids == 1) != (wtr -> kids.one != NULL))) return 0;
+    if (wtr -> capkids && wtr -> nkids > wtr -> capkids) return 0;
+
+    for (unsigned i = 0; i < wtr -> nkids; i++)
+    {
+        struct wTrie* kid = wTrie_kid (wtr, i);
+        if (!kid || kid -> wc != wTrie_kidwc (wtr, i)) return 0;
+        if (i > 0 && wTrie_kidwc (wtr, i - 1) >= kid -> wc) return 0;
+        if (wtr -> table && wtr -> table -> slot[kid -> wc - wtr -> table -> lo] != kid) return 0;
+    }
+    return 1;
+}
+
+/** @brief Consistency check of the whole tree, see wTrie_nodeOK.
+ *
+ * Walks the tree with an explicit stack, so the depth of the tree costs heap memory, not call stack.
+ *
+ * @return @b 1 if check succeeds, @b 0 if it fails or runs out of memory.
  *
  */
 
 int wTrie_rOK (struct wTrie* wtr)
 {
-    return wtr && 
-           (wtr -> sibling ? wTrie_rOK (wtr -> sibling) : 1) &&
-           (wtr -> child   ? wTrie_rOK (wtr -> child)   : 1);
+    struct wTrie** stack = NULL;
+    size_t n   = 0;
+    size_t cap = 0;
+    int ok = wtr && wTrie_push (&stack, &n, &cap, wtr);
+    while (ok && n)
+    {
+        struct wTrie* node = stack[--n];
+        ok = wTrie_nodeOK (node);
+        for (unsigned i = 0; ok && i < node -> nkids; i++)
+            ok = wTrie_push (&stack, &n, &cap, wTrie_kid (node, i));
+    }
+    free (stack);
+    return ok;
 }
 
 /** @brief Constructor of wTries and new nodes. Should ALWAYS be called after creating a wTrie.
  *
- * Initializes the wTrie instance pointed by @c wtr with supplied values. Sibling and child pointers
- * are set to @c NULL. 
+ * Initializes the wTrie instance pointed by @c wtr with supplied values. The node has no children,
+ * count is set to zero.
  *
  * @return @b 0 if supplied with a NULL @c wtr pointer, 1 otherwise.
  */
@@ -105,12 +434,18 @@ int wTrie_init (struct wTrie* wtr, //!< Pointer to initialize at
                 size_t meta_sz     //!< Size of memory to allocate for metadata. Ignores supplied void* meta
                 )
 {
-    _PRECONDITION (wtr, E_WTRIE_NULLPOINTER, return 0);
-
-    wtr -> sibling = NULL;
-    wtr -> child   = NULL;
+    _PRECONDITION_CHEAP (wtr, E_WTRIE_NULLPOINTER, return 0);
+
+    wtr -> nkids    = 0;
+    wtr -> capkids  = 0;
+    wtr -> kids.one = NULL;
+    wtr -> table    = NULL;
+    wtr -> poolkids = 0;
+    wtr -> suffix   = NULL;
     wtr -> wc      = wc;
     wtr -> term    = term;
+    wtr -> pooled  = 0;
+    wtr -> count   = 0;
     if (meta_sz > 0)
     {
         if (meta) errno = W_WTRIE_METANOTSET;
@@ -123,44 +458,57 @@ int wTrie_init (struct wTrie* wtr, //!< Pointer to initialize at
     return 1;
 }
 
-/** @brief Prints wTrie structure contents recursively to standard output.
+/** @brief Prints wTrie structure contents to standard output.
  *
  * Useful for debugging. Performs consistency check with @c wTrie_rOK before dumping. Terminating nodes
  * are marked with '.', nodes containing non-NULL meta pointers are marked with '*'. Nodes containing 
- * newline and null characters are printed as {n} and {0}.
- *
- * @warning The function uses a static variable and is therefore thread unsafe. Using it for other purposes
- * than debugging is deprecated.
+ * newline and null characters are printed as {n} and {0}. Nodes are printed in order of their words from
+ * an explicit stack, in which a NULL marks the end of children of a node.
  */
 
 void wTrie_dump (struct wTrie* wtr)
 {
-    _PRECONDITION (wTrie_rOK, E_WTRIE_CORRUPT, return);
-
-    static int level = 0;
-
-    for (int i = 0; i < level - 1; i++) wprintf (L"    ");
-    if (level > 0) wprintf (L" `--");
-    if (wtr -> wc == L'\0')
-        wprintf (L"{0}\n");
-    else if (wtr -> wc == L'\n')
-        wprintf (L"{n}\n");
-    else
-        wprintf (L"[%lc]%lc%lc\n", wtr -> wc,
-                                (wtr -> term ? L'.' : L' '),
-                                (wtr -> meta ? L'*' : L' '));
-
-    level++;
-
-    for (struct wTrie* child = wtr -> child; child; child = child -> sibling)
-        wTrie_dump (child);
+    _PRECONDITION_FULL (wTrie_rOK (wtr), E_WTRIE_CORRUPT, return);
+
+    struct wTrie** stack = NULL;
+    size_t n   = 0;
+    size_t cap = 0;
+    int level  = 0;
+    int ok = wTrie_push (&stack, &n, &cap, wtr);
+    while (ok && n)
+    {
+        struct wTrie* node = stack[--n];
+        if (!node)
+        {
+            level--;
+            continue;
+        }
 
-    level--;    
+        for (int i = 0; i < level - 1; i++) wprintf (L"    ");
+        if (level > 0) wprintf (L" `--");
+        if (node -> wc == L'\0')
+            wprintf (L"{0}\n");
+        else if (node -> wc == L'\n')
+            wprintf (L"{n}\n");
+        else
+            wprintf (L"[%lc]%lc%lc\n", node -> wc,
+                                    (node -> term ? L'.' : L' '),
+                                    (node -> meta ? L'*' : L' '));
+
+        level++;
+        ok = wTrie_push (&stack, &n, &cap, NULL);
+        for (unsigned i = node -> nkids; ok && i-- > 0; )
+            ok = wTrie_push (&stack, &n, &cap, wTrie_kid (node, i));
+    }
+    free (stack);
 }
 
-/** @brief The poisonous node destructor.
+/** @brief The node destructor.
  *
- * Fills the memory allocated for the supplied node with @c C3 ("poison") byte, then frees the memory.
+ * Frees the memory allocated for the supplied node, its meta and its children array. Pooled nodes are
+ * left to their pool,
+ * which releases them in wTrie_pool_free. If @c WTRIE_POISON is defined, the node is filled with @c C3
+ * ("poison") byte first.
  *
  * @return @b 0 if supplied with a NULL @c wtr pointer, @b 1 otherwise.
  * @warning Operation is non-recursive and discards only one given node. Any children and siblings of
@@ -170,71 +518,312 @@ void wTrie_dump (struct wTrie* wtr)
 
 int wTrie_discard (struct wTrie* wtr)
 {
-    _PRECONDITION (wtr, E_WTRIE_NULLPOINTER, return 0);
+    _PRECONDITION_CHEAP (wtr, E_WTRIE_NULLPOINTER, return 0);
 
-    if (wtr -> meta) free (wtr -> meta);
+    bool pooled = wtr -> pooled;
+    if (!wtr -> poolkids)
+    {
+        if (wtr -> capkids) free (wtr -> kids.many);
+        free (wtr -> table);
+    }
+    if (wtr -> meta && !pooled) free (wtr -> meta);
+#ifdef WTRIE_POISON
     memset (wtr, 0xC3, sizeof (struct wTrie));
-    free (wtr);
+#endif
+    if (!pooled) free (wtr);
 
     return 1;
 }
 
+/** @brief Takes a node from the pool and initializes it, see wTrie_init.
+ *
+ * If @b meta_sz is non-zero, meta is taken from the pool as well and zeroed.
+ *
+ * @return NULL if fails, pointer to the new node otherwise.
+ */
+
+struct wTrie* wTrie_pool_node (struct wTrie_pool* pool, wchar_t wc, bool term, void* meta, size_t meta_sz)
+{
+    struct wTrie* node = wTrie_pool_alloc (pool, sizeof (struct wTrie));
+    if (!node) return NULL;
+
+    wTrie_init (node, wc, term, meta, 0);
+    node -> pooled = 1;
+    if (meta_sz > 0)
+    {
+        if (meta) errno = W_WTRIE_METANOTSET;
+        node -> meta = wTrie_pool_alloc (pool, meta_sz);
+        if (node -> meta) memset (node -> meta, 0, meta_sz);
+    }
+    pool -> nnodes++;
+    WSTATS_ADD (nodes, 1);
+    WSTATS_ADD (node_bytes, sizeof (struct wTrie) + meta_sz);
+    return node;
+}
+
 /** @brief Search child of a node by given symbol.
  *
- * Performs list traversal of given node's (parent) children, comparing their @b wc with supplied @b wch.
- * Returns pointer to the found child. If @b lsibling_p is not NULL, puts there a pointer to the previous
- * sibling of found node, if any. Does not perform consistency check before operation.
+ * Looks the given node's (parent) children up by @b wch: through the direct-indexed table if the parent
+ * has one, by scanning or binary search of the sorted symbols otherwise. Returns pointer to the found
+ * child. If @b lsibling_p is not NULL, puts there a pointer to the previous sibling of found node in order
+ * of symbols, if any. Does not perform consistency check before operation.
  *
  * @return NULL if no children were found or parent supplied was NULL. Pointer to the found child otherwise. 
  */
 
 struct wTrie* wTrie_child (struct wTrie* parent, wchar_t wch, struct wTrie** lsibling_p)
 {
-    _PRECONDITION (parent, E_WTRIE_ORPHAN, return NULL);
+    _PRECONDITION_CHEAP (parent, E_WTRIE_ORPHAN, return NULL);
+
+    WSTATS_ADD (child_calls, 1);
+    struct wTrie_table* table = parent -> table;
+    if (table && !lsibling_p)
+    {
+        WSTATS_ADD (child_tables, 1);
+        unsigned long idx = (unsigned long)((long)wch - (long)table -> lo);
+        return idx < table -> size ? table -> slot[idx] : NULL;
+    }
 
     struct wTrie* lostchild = NULL;
-    struct wTrie* lsib = NULL;
-    
-    for (struct wTrie* child = parent -> child; child && !lostchild; child = child -> sibling)
+    unsigned pos = wTrie_kidpos (parent, wch);
+    if (pos < parent -> nkids && wTrie_kidwc (parent, pos) == wch)
     {
-        if (child -> wc == wch)
-        {
-            lostchild = child;
-            if (lsibling_p) *lsibling_p = lsib;
-        }
-        if (child != parent -> child)
-        {
-            lsib = child;
-        }
+        lostchild = wTrie_kid (parent, pos);
+        if (lsibling_p) *lsibling_p = pos ? wTrie_kid (parent, pos - 1) : NULL;
     }
    
     return lostchild;
 }
 
+/** @brief Service function returning the size of a children array of given capacity. */
+
+size_t wTrie_kidsize (unsigned cap)
+{
+    return cap * (sizeof (struct wTrie*) + sizeof (wchar_t));
+}
+
+/** @brief Service function returning the size of a direct-indexed table with given number of slots. */
+
+size_t wTrie_tablesize (unsigned size)
+{
+    return sizeof (struct wTrie_table) + size * sizeof (struct wTrie*);
+}
+
+/** @brief Service function taking memory for children arrays and tables from @b pool, or from malloc if
+ * @b pool is NULL. Sizes are rounded up to a power of 2, which callers use as spare capacity.
+ */
+
+void* wTrie_kidalloc (struct wTrie_pool* pool, size_t size)
+{
+    WSTATS_ADD (kid_bytes, (size_t)1 << wTrie_pool_class (size));
+    return pool ? wTrie_pool_get (pool, size) : malloc ((size_t)1 << wTrie_pool_class (size));
+}
+
+/** @brief Service function releasing memory taken with wTrie_kidalloc for the children of @b wtr.
+ *
+ * Pooled memory is returned to @b pool if given, and left to its pool otherwise.
+ */
+
+void wTrie_kidrelease (struct wTrie_pool* pool, struct wTrie* wtr, void* mem, size_t size)
+{
+    if (!mem) return;
+    if (!wtr -> poolkids) free (mem);
+    else if (pool)        wTrie_pool_put (pool, mem, size);
+}
+
+/** @brief Service function (re)building the direct-indexed table of a node.
+ *
+ * The table is dropped if the node is not dense enough, see wTrie_table.
+ *
+ * @return 0 if fails to allocate the table, 1 otherwise.
+ */
+
+int wTrie_retable (struct wTrie_pool* pool, struct wTrie* wtr)
+{
+    struct wTrie_table* old = wtr -> table;
+    wtr -> table = NULL;
+    if (old) wTrie_kidrelease (pool, wtr, old, wTrie_tablesize (old -> size));
+
+    unsigned n = wtr -> nkids;
+    if (n < WTRIE_DENSE_MIN) return 1;
+
+    const wchar_t* keys = wTrie_keys (wtr);
+    unsigned long range = (unsigned long)((long)keys[n - 1] - (long)keys[0]) + 1;
+    if (range > (unsigned long)WTRIE_DENSE_RATIO * n) return 1;
+
+    size_t bytes = (size_t)1 << wTrie_pool_class (wTrie_tablesize (range));
+    struct wTrie_table* table = wTrie_kidalloc (pool, bytes);
+    if (!table)
+    {
+        errno = E_WTRIE_SPAWNFAILED;
+        return 0;
+    }
+    table -> lo   = keys[0];
+    table -> size = (bytes - sizeof (struct wTrie_table)) / sizeof (struct wTrie*);
+    memset (table -> slot, 0, table -> size * sizeof (struct wTrie*));
+    for (unsigned i = 0; i < n; i++)
+        table -> slot[keys[i] - table -> lo] = wtr -> kids.many[i];
+
+    wtr -> table = table;
+    return 1;
+}
+
+/** @brief Service function growing the children array of a node to hold at least @b need children.
+ *
+ * Memory is taken from @b pool, or from malloc if pool is NULL. A table taken from the other source is
+ * dropped, to be rebuilt by the caller.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wTrie_regrow (struct wTrie_pool* pool, struct wTrie* wtr, unsigned need)
+{
+    unsigned cap = wtr -> capkids ? wtr -> capkids : 1;
+    while (cap < need) cap *= 2;
+
+    size_t bytes = (size_t)1 << wTrie_pool_class (wTrie_kidsize (cap));
+    struct wTrie** many = wTrie_kidalloc (pool, bytes);
+    if (!many)
+    {
+        errno = E_WTRIE_SPAWNFAILED;
+        return 0;
+    }
+    cap = bytes / (sizeof (struct wTrie*) + sizeof (wchar_t));
+
+    wchar_t* keys = (wchar_t*)(many + cap);
+    for (unsigned i = 0; i < wtr -> nkids; i++)
+    {
+        many[i] = wTrie_kid (wtr, i);
+        keys[i] = wTrie_kidwc (wtr, i);
+    }
+
+    if (wtr -> capkids) wTrie_kidrelease (pool, wtr, wtr -> kids.many, wTrie_kidsize (wtr -> capkids));
+    if (wtr -> table && (pool != NULL) != wtr -> poolkids)
+    {
+        wTrie_kidrelease (pool, wtr, wtr -> table, wTrie_tablesize (wtr -> table -> size));
+        wtr -> table = NULL;
+    }
+
+    wtr -> kids.many = many;
+    wtr -> capkids   = cap;
+    wtr -> poolkids  = (pool != NULL);
+    return 1;
+}
+
+/** @brief Links an orphan node as a child of @b parent, keeping children sorted by symbol.
+ *
+ * The parent shall not have a child with the same symbol already. Children arrays and tables are taken
+ * from @b pool, or from malloc if pool is NULL.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wTrie_adopt (struct wTrie_pool* pool, struct wTrie* parent, struct wTrie* child)
+{
+    _PRECONDITION_CHEAP ((parent && child), E_WTRIE_NULLPOINTER, return 0);
+
+    unsigned n = parent -> nkids;
+    if (n == 0 && !parent -> capkids)
+    {
+        parent -> kids.one = child;
+        parent -> nkids = 1;
+        return 1;
+    }
+
+    unsigned pos = wTrie_kidpos (parent, child -> wc);
+    if (n >= parent -> capkids || (pool != NULL) != parent -> poolkids)
+    {
+        if (!wTrie_regrow (pool, parent, n + 1)) return 0;
+    }
+
+    struct wTrie** many = parent -> kids.many;
+    wchar_t* keys = wTrie_keys (parent);
+    memmove (many + pos + 1, many + pos, (n - pos) * sizeof (struct wTrie*));
+    memmove (keys + pos + 1, keys + pos, (n - pos) * sizeof (wchar_t));
+    many[pos] = child;
+    keys[pos] = child -> wc;
+    parent -> nkids++;
+
+    struct wTrie_table* table = parent -> table;
+    unsigned long idx = table ? (unsigned long)((long)child -> wc - (long)table -> lo) : 0;
+    if (table && idx < table -> size)
+        table -> slot[idx] = child;
+    else if (parent -> nkids >= WTRIE_DENSE_MIN)
+        return wTrie_retable (pool, parent);
+
+    return 1;
+}
+
+/** @brief Unlinks the i-th child from @b parent, not discarding it.
+ *
+ * @return Pointer to the unlinked child, NULL if @b i is out of range.
+ */
+
+struct wTrie* wTrie_unlink (struct wTrie* parent, unsigned i)
+{
+    _PRECONDITION_CHEAP (parent,              E_WTRIE_ORPHAN,     return NULL);
+    _PRECONDITION_CHEAP (i < parent -> nkids, E_WTRIE_NOSUCHNODE, return NULL);
+
+    struct wTrie* child = wTrie_kid (parent, i);
+    unsigned n = --parent -> nkids;
+    if (!parent -> capkids)
+    {
+        parent -> kids.one = NULL;
+    }
+    else
+    {
+        wchar_t* keys = wTrie_keys (parent);
+        memmove (parent -> kids.many + i, parent -> kids.many + i + 1, (n - i) * sizeof (struct wTrie*));
+        memmove (keys + i, keys + i + 1, (n - i) * sizeof (wchar_t));
+    }
+    if (parent -> table) parent -> table -> slot[child -> wc - parent -> table -> lo] = NULL;
+
+    return child;
+}
+
 /** @brief Spawns a child with given parameters to a given node.
  *
  * Creates a new child to the supplied @b parent node and initializes it with supplied wch, term, and meta 
- * values. Newly created child is linked directly to the parent, and other children of the parent, if any, 
- * are linked to the created node. If finds a child with the same @b wch value and if strict flag is 
+ * values. Newly created child is inserted among other children of the parent in order of symbols, see
+ * wTrie_adopt. If finds a child with the same @b wch value and if strict flag is 
  * non-zero, function fails. If strict is zero, overwrites the found child with supplied values, not 
- * changing its position. Fails if parent is NULL.
+ * changing its position. Fails if parent is NULL. New node is taken from @b pool, or allocated with calloc
+ * if @b pool is NULL.
  *
  * @return NULL if fails, pointer to the created (overwritted) node otherwise.
  */
 
-struct wTrie* wTrie_spawn (bool strict, struct wTrie* parent,
-                           wchar_t wch, bool term, void* meta, size_t meta_sz)
+struct wTrie* wTrie_spawn_from (struct wTrie_pool* pool, bool strict, struct wTrie* parent,
+                                wchar_t wch, bool term, void* meta, size_t meta_sz)
 {
-    _PRECONDITION (parent, E_WTRIE_ORPHAN, return NULL);
+    _PRECONDITION_CHEAP (parent, E_WTRIE_ORPHAN, return NULL);
 
     struct wTrie* child = wTrie_child (parent, wch, NULL); 
     struct wTrie* newborn = NULL;
     if (!child)
     {
-        newborn = calloc (1, sizeof (struct wTrie));
-        wTrie_init (newborn, wch, term, meta, meta_sz);
-        if (parent -> child) newborn -> sibling = parent -> child;
-        parent -> child = newborn;
+        if (pool)
+        {
+            newborn = wTrie_pool_node (pool, wch, term, meta, meta_sz);
+        }
+        else
+        {
+            newborn = calloc (1, sizeof (struct wTrie));
+            wTrie_init (newborn, wch, term, meta, meta_sz);
+            WSTATS_ADD (nodes, 1);
+            WSTATS_ADD (node_bytes, sizeof (struct wTrie) + meta_sz);
+        }
+        if (!newborn)
+        {
+            errno = E_WTRIE_SPAWNFAILED;
+            return NULL;
+        }
+        if (!wTrie_adopt (pool, parent, newborn))
+        {
+            wTrie_discard (newborn);
+            errno = E_WTRIE_SPAWNFAILED;
+            return NULL;
+        }
     }
     else
     {
@@ -259,57 +848,161 @@ struct wTrie* wTrie_spawn (bool strict, struct wTrie* parent,
     }
 }
 
-/** @brief Recursively poisonously discards a node, its siblings and children. */
+/** @brief Same as spawn_from, always allocating the new node with calloc. */
 
-void wTrie_purge (struct wTrie* wtr)
+struct wTrie* wTrie_spawn (bool strict, struct wTrie* parent,
+                           wchar_t wch, bool term, void* meta, size_t meta_sz)
+{
+    return wTrie_spawn_from (NULL, strict, parent, wch, term, meta, meta_sz);
+}
+
+/** @brief Finds or spawns a child of a node by given symbol, maintaining suffix links.
+ *
+ * Works like a non-strict wTrie_spawn of a plain node, but also sets the suffix link of the spawned child
+ * to the node of the same word without its first symbol. Missing nodes along the chain of @b parent's
+ * suffix links are spawned as well, so every prefix of every suffix of every word stays in the tree.
+ * Children of @b root link back to @b root. The chain is walked with a loop, an existing child stops it,
+ * so the cost is amortized O(1) per spawned node. New nodes are taken from @b pool, see wTrie_spawn_from.
+ *
+ * @warning All nodes from @b root down to @b parent must have been created by this function, otherwise
+ * suffix links along the way are NULL and the function fails.
+ *
+ * @return NULL if fails, pointer to the found (spawned) child otherwise.
+ */
+
+struct wTrie* wTrie_slchild (struct wTrie_pool* pool, struct wTrie* root, struct wTrie* parent, wchar_t wch)
 {
-    _PRECONDITION (wTrie_rOK, E_WTRIE_CORRUPT, return);
+    _PRECONDITION_CHEAP ((root && parent), E_WTRIE_NULLPOINTER, return NULL);
 
-    struct wTrie* sib = wtr -> sibling;
-    struct wTrie* child = wtr -> child;
+    struct wTrie* found = NULL;
+    struct wTrie* unlinked = NULL;
+    struct wTrie* child = NULL;
+    bool spawned = 0;
+
+    for (struct wTrie* node = parent; ; node = node -> suffix)
+    {
+        _PRECONDITION_CHEAP (node, E_WTRIE_CORRUPT, return NULL);
+
+        child = wTrie_child (node, wch, NULL);
+        spawned = !child;
+        if (spawned)
+        {
+            child = wTrie_spawn_from (pool, 1, node, wch, 0, NULL, 0);
+            if (!child) return NULL;
+        }
 
-    wTrie_discard (wtr);
+        if (unlinked) unlinked -> suffix = child;
+        else          found = child;
 
-    if (sib) wTrie_purge (sib);
-    if (child) wTrie_purge (child);
+        if (!spawned) break;
+        if (node == root)
+        {
+            child -> suffix = root;
+            break;
+        }
+        unlinked = child;
+    }
+
+    return found;
 }
 
-/** @brief Purges a child containing the given wch symbol, preserving its siblings.
+/** @brief Merges the tree @b src into the tree @b dst.
  *
- * Function locates the child which contains the given @b wch symbol. After that, it links its sibling, if
- * any, to parent if the child was linked to parent, or to the previous sibling otherwise. Finally, 
- * it issues recursive purge on the child (cutting off its sibling first).
+ * Counts of nodes of the same words are summed up and terminating flags are joined. Subtrees missing in
+ * @b dst are linked in from @b src as they are, without copying, so @b src is destroyed: its nodes are
+ * either linked into @b dst or left unreachable. Nodes of @b src taken from a pool shall be released
+ * together with @b dst, see wTrie_pool_absorb. Children arrays and tables are taken from @b pool. Suffix
+ * links are not valid after merging, see wTrie_relink.
  *
  * @return 0 if fails, 1 otherwise.
  */
 
-int wTrie_collapse (struct wTrie* parent, wchar_t wch)
+int wTrie_merge (struct wTrie_pool* pool, struct wTrie* dst, struct wTrie* src)
 {
-    _PRECONDITION (parent, E_WTRIE_ORPHAN, return 0);
+    _PRECONDITION_CHEAP ((dst && src), E_WTRIE_NULLPOINTER, return 0);
 
-    struct wTrie* child = NULL;
-    struct wTrie* lsib = NULL; 
-    child = wTrie_child (parent, wch, &lsib);
-    if (!child)
+    dst -> count += src -> count;
+    dst -> term  |= src -> term;
+    for (unsigned i = 0; i < src -> nkids; i++)
     {
-        errno = E_WTRIE_NOSUCHNODE;
-        return 0;
+        struct wTrie* kid  = wTrie_kid (src, i);
+        struct wTrie* same = wTrie_child (dst, kid -> wc, NULL);
+        if (same ? !wTrie_merge (pool, same, kid) : !wTrie_adopt (pool, dst, kid)) return 0;
+    }
+    return 1;
+}
+
+/** @brief Restores suffix links of the whole tree, as maintained by wTrie_slchild.
+ *
+ * The link of a child is looked up among children of its parent's link, so links are set from the root
+ * down. Useful after wTrie_merge: a merge of trees built with wTrie_slchild again has the suffix of every
+ * word, so every link is found.
+ *
+ * @return 0 if the suffix of some word is not in the tree, whose link is left NULL then, 1 otherwise.
+ */
+
+int wTrie_relink (struct wTrie* root, struct wTrie* wtr)
+{
+    _PRECONDITION_CHEAP ((root && wtr), E_WTRIE_NULLPOINTER, return 0);
+
+    int ok = 1;
+    for (unsigned i = 0; i < wtr -> nkids; i++)
+    {
+        struct wTrie* kid = wTrie_kid (wtr, i);
+        if (wtr == root)        kid -> suffix = root;
+        else if (wtr -> suffix) kid -> suffix = wTrie_child (wtr -> suffix, kid -> wc, NULL);
+        else                    kid -> suffix = NULL;
+
+        if (!wTrie_relink (root, kid) || !kid -> suffix) ok = 0;
     }
+    return ok;
+}
 
-    if (child -> sibling)
+/** @brief Discards a node and all of its descendants.
+ *
+ * Needs neither recursion nor memory: nodes waiting to be discarded are chained through their suffix
+ * links, which are of no use in a subtree being destroyed anyway.
+ */
+
+void wTrie_purge (struct wTrie* wtr)
+{
+    _PRECONDITION_FULL (wTrie_rOK (wtr), E_WTRIE_CORRUPT, return);
+
+    wtr -> suffix = NULL;
+    while (wtr)
     {
-        if (lsib)
+        struct wTrie* next = wtr -> suffix;
+        for (unsigned i = 0; i < wtr -> nkids; i++)
         {
-            lsib -> sibling = child -> sibling;
-        }
-        else
-        {
-            parent -> child = child -> sibling;
+            struct wTrie* kid = wTrie_kid (wtr, i);
+            kid -> suffix = next;
+            next = kid;
         }
+        wTrie_discard (wtr);
+        wtr = next;
     }
-    
-    child -> sibling = NULL;
-    wTrie_purge (child);
+}
+
+/** @brief Purges a child containing the given wch symbol, preserving its siblings.
+ *
+ * Function locates the child which contains the given @b wch symbol, unlinks it from the parent and
+ * issues recursive purge on it.
+ *
+ * @return 0 if fails, 1 otherwise.
+ */
+
+int wTrie_collapse (struct wTrie* parent, wchar_t wch)
+{
+    _PRECONDITION_CHEAP (parent, E_WTRIE_ORPHAN, return 0);
+
+    unsigned pos = wTrie_kidpos (parent, wch);
+    if (pos >= parent -> nkids || wTrie_kidwc (parent, pos) != wch)
+    {
+        errno = E_WTRIE_NOSUCHNODE;
+        return 0;
+    }
+
+    wTrie_purge (wTrie_unlink (parent, pos));
     return 1;
 }
 
@@ -323,30 +1016,26 @@ int wTrie_collapse (struct wTrie* parent, wchar_t wch)
 
 struct wTrie* wTrie_addword (struct wTrie* wtr, const wchar_t* wstring)
 {
-    _PRECONDITION ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
-    _PRECONDITION (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
+    _PRECONDITION_CHEAP ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
+    _PRECONDITION       (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
 
-    if (*(wstring + 1) != L'\0')
-    {
-        struct wTrie* nwtr = wTrie_spawn (0, wtr, *wstring, 0, NULL, 0);
-        return wTrie_addword (nwtr, wstring + 1);
-    }
-    else return wTrie_spawn (0, wtr, *wstring, 1, NULL, 0);
+    for (; wtr && wstring[1] != L'\0'; wstring++)
+        wtr = wTrie_spawn (0, wtr, *wstring, 0, NULL, 0);
+
+    return wtr ? wTrie_spawn (0, wtr, *wstring, 1, NULL, 0) : NULL;
 }
 
 /** @brief Same as addword, but adds only first n symbols of wstring */
 
 struct wTrie* wTrie_addnword (struct wTrie* wtr, const wchar_t* wstring, int n)
 {
-    _PRECONDITION ((wstring && wtr),     E_WTRIE_NULLPOINTER, return NULL);
-    _PRECONDITION ((*wstring && n >= 1), E_WTRIE_EMPTYWORD,   return NULL);
+    _PRECONDITION_CHEAP ((wstring && wtr),     E_WTRIE_NULLPOINTER, return NULL);
+    _PRECONDITION       ((*wstring && n >= 1), E_WTRIE_EMPTYWORD,   return NULL);
 
-    if (*(wstring + 1) != L'\0' && n > 1)
-    {
-        struct wTrie* nwtr = wTrie_spawn (0, wtr, *wstring, 0, NULL, 0);
-        return wTrie_addnword (nwtr, wstring + 1, n - 1);
-    }
-    else return wTrie_spawn (0, wtr, *wstring, 1, NULL, 0);
+    for (; wtr && wstring[1] != L'\0' && n > 1; wstring++, n--)
+        wtr = wTrie_spawn (0, wtr, *wstring, 0, NULL, 0);
+
+    return wtr ? wTrie_spawn (0, wtr, *wstring, 1, NULL, 0) : NULL;
 }
 
 /** @brief Finds the given word in the tree.
@@ -357,21 +1046,19 @@ struct wTrie* wTrie_addnword (struct wTrie* wtr, const wchar_t* wstring, int n)
 
 struct wTrie* wTrie_findword (struct wTrie* wtr, const wchar_t* wstring)
 {
-    _PRECONDITION ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
-    _PRECONDITION (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
-    
-    struct wTrie* child = wTrie_child (wtr, *wstring, NULL);
-    if (child)
+    _PRECONDITION_CHEAP ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
+    _PRECONDITION       (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
+
+    for (; wtr && *wstring != L'\0'; wstring++)
+        wtr = wTrie_child (wtr, *wstring, NULL);
+
+    if (wtr && wtr -> term)
     {
-        if (child -> term && *(wstring + 1) == L'\0')
-        {
-            return child;
-        }
-        else if (*(wstring + 1) != L'\0')
-        {
-            return wTrie_findword (child, wstring + 1);
-        }
+        WSTATS_ADD (find_hits, 1);
+        return wtr;
     }
+
+    WSTATS_ADD (find_misses, 1);
     errno = I_WTRIE_NOSUCHWORD;
     return NULL;
 }
@@ -382,37 +1069,20 @@ struct wTrie* wTrie_findword (struct wTrie* wtr, const wchar_t* wstring)
 struct wTrie* wTrie_findword_rel (struct wTrie* wtr, const wchar_t* wstring,
                                   struct wTrie** parent_p, struct wTrie** lsibling_p)
 {
-    _PRECONDITION ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
-    _PRECONDITION (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
+    _PRECONDITION_CHEAP ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
+    _PRECONDITION       (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
+
+    struct wTrie* parent = wtr;
+    for (; parent && wstring[1] != L'\0'; wstring++)
+        parent = wTrie_child (parent, *wstring, NULL);
 
-    struct wTrie* child = wTrie_child (wtr, *wstring, *(wstring + 1) == L'\0' ? lsibling_p : NULL);
-    if (child)
+    struct wTrie* lsibling = NULL;
+    struct wTrie* child = parent ? wTrie_child (parent, *wstring, &lsibling) : NULL;
+    if (child && child -> term)
     {
-        if (child -> term && *(wstring + 1) == L'\0')
-        {
-            return child;
-        }
-        else if (*(wstring + 1) != L'\0')
-        {
-            if (*(wstring + 2) == L'\0')
-            {
-                struct wTrie* mbchild = NULL;
-                struct wTrie* mbparent = child;
-                struct wTrie* mblsibling = NULL;
-
-                mbchild = wTrie_findword_rel (child, wstring + 1, &mbparent, &mblsibling);
-                if (mbchild)
-                {
-                    if (parent_p) *parent_p = mbparent;
-                    if (lsibling_p) *lsibling_p = mblsibling;
-                    return mbchild;
-                }
-            }
-            else
-            {
-                return wTrie_findword_rel (child, wstring + 1, parent_p, lsibling_p);
-            }
-        }
+        if (parent_p && parent != wtr) *parent_p = parent;
+        if (lsibling_p) *lsibling_p = lsibling;
+        return child;
     }
     errno = I_WTRIE_NOSUCHWORD;
     return NULL;
@@ -422,17 +1092,9 @@ struct wTrie* wTrie_findword_rel (struct wTrie* wtr, const wchar_t* wstring,
 
 bool wTrie_hasmultichild (struct wTrie* wtr)
 {
-    _PRECONDITION (wtr, E_WTRIE_NULLPOINTER, return false);
+    _PRECONDITION_CHEAP (wtr, E_WTRIE_NULLPOINTER, return false);
 
-    if (wtr -> child)
-    {
-        if (wtr -> child -> sibling)
-            return true;
-        else
-            return false;
-    }
-    else
-        return false;
+    return wtr -> nkids > 1;
 }
 
 /** @brief Finds a leaf of the given word in the tree.
@@ -445,11 +1107,11 @@ bool wTrie_hasmultichild (struct wTrie* wtr)
 
 struct wTrie* wTrie_leaf (struct wTrie* wtr, const wchar_t* wstring, struct wTrie** parent_p)
 {
-    _PRECONDITION ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
-    _PRECONDITION (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
+    _PRECONDITION_CHEAP ((wstring && wtr), E_WTRIE_NULLPOINTER, return NULL);
+    _PRECONDITION       (*wstring,         E_WTRIE_EMPTYWORD,   return NULL);
 
     struct wTrie* endnode = wTrie_findword (wtr, wstring);
-    _PRECONDITION (endnode,          E_WTRIE_NOSUCHWORD,  return NULL);
+    _PRECONDITION       (endnode,          E_WTRIE_NOSUCHWORD,  return NULL);
 
     struct wTrie* leaf = NULL;
     struct wTrie* node = wtr; int i = 0;
@@ -478,7 +1140,7 @@ struct wTrie* wTrie_leaf (struct wTrie* wtr, const wchar_t* wstring, struct wTri
         }
         else
         {
-            if (node -> child)
+            if (node -> nkids)
             {
                 leaf = NULL; parent = NULL;
             }
@@ -501,11 +1163,11 @@ struct wTrie* wTrie_leaf (struct wTrie* wtr, const wchar_t* wstring, struct wTri
 int wTrie_rmword (struct wTrie* wtr, const wchar_t* wstring)
 {
     struct wTrie* endnode = wTrie_findword (wtr, wstring);
-    _PRECONDITION (endnode,          E_WTRIE_NOSUCHWORD,  return NULL);
+    _PRECONDITION (endnode, E_WTRIE_NOSUCHWORD, return 0);
 
     struct wTrie* parent = NULL;
     struct wTrie* leaf = wTrie_leaf (wtr, wstring, &parent);
-    if (leaf && !(endnode -> child))
+    if (leaf && !(endnode -> nkids))
     {
         wTrie_collapse (parent, leaf -> wc);
     }